@@ -0,0 +1,196 @@
+//
+// Heap allocations in the block update primitives of SparseBlockMatrix (see BlockDelta in SparseBlockMatrix.h)
+//
+//   Counts the calls to operator new made by updateBlock / addBlock, by a sweep of concaveCDInit over all pairs and
+//   by a pass of concaveCD over the active set, starting from a realistic estimate computed with gridCCDr. The
+//   primitives and the sweeps should not allocate at all once the structure of betas has settled (addBlock only
+//   allocates when a column runs out of room, see STORAGE in SparseBlockMatrix.h). Compile and run with
+//
+//       g++ -O2 -D_CCDR_STANDALONE_ -I src benchmarks/block_updates.cpp -o block_updates
+//       ./block_updates [pp] [nn]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include "algorithm.h"
+#include "correlations.h"
+
+// Every allocation in the program goes through here
+static std::size_t allocations = 0;
+
+void* operator new(std::size_t size){
+    ++allocations;
+    void* p = malloc(size == 0 ? 1 : size);
+    if(p == NULL) throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](std::size_t size){
+    return operator new(size);
+}
+
+void operator delete(void* p) throw(){
+    free(p);
+}
+
+void operator delete[](void* p) throw(){
+    free(p);
+}
+
+// Since C++14 the sized versions are called when the size is known, so they have to be replaced as well
+#if __cplusplus >= 201402L
+void operator delete(void* p, std::size_t) throw(){
+    free(p);
+}
+
+void operator delete[](void* p, std::size_t) throw(){
+    free(p);
+}
+#endif
+
+// Deterministic random numbers (xorshift), as in sbm_layout.cpp
+static uint64_t state = 88172645463325252ULL;
+
+double runif(){
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double rnorm(){
+    return sqrt(-2.0 * log(runif() + 1e-300)) * cos(6.283185307179586 * runif());
+}
+
+double seconds(clock_t start){
+    return static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+}
+
+int main(int argc, char** argv){
+    int pp = (argc > 1) ? atoi(argv[1]) : 1000;
+    int nn = (argc > 2) ? atoi(argv[2]) : 200;
+
+    //
+    // Random sparse DAG with ~2 parents per node, sampled in topological order
+    //
+    std::vector<double> X(static_cast<std::size_t>(nn) * pp);
+    for(int j = 0; j < pp; ++j){
+        for(int r = 0; r < nn; ++r) X[r + j * nn] = rnorm();
+        for(int i = 0; i < j; ++i){
+            if(runif() >= 2.0 / pp) continue;
+
+            double b = (runif() < 0.5 ? -1 : 1) * (0.5 + 1.5 * runif());
+            for(int r = 0; r < nn; ++r) X[r + j * nn] += b * X[r + i * nn];
+        }
+    }
+
+    std::vector<double> cors(static_cast<std::size_t>(pp) * (pp + 1) / 2);
+    packedCorrelations(&X[0], nn, pp, &cors[0], 1);
+    PackedSymmetricMatrix P(&cors[0], pp);
+
+    //
+    // Estimate at the end of a short grid of lambdas
+    //
+    std::vector<double> lambdas, params;
+    for(int l = 0; l < 10; ++l) lambdas.push_back(sqrt(static_cast<double>(nn)) * pow(0.1, l / 9.0));
+    params.push_back(2.0);
+    params.push_back(1e-4);
+    params.push_back(2 * std::max(10.0, sqrt(static_cast<double>(pp))));
+    params.push_back(10);
+
+    SparseBlockMatrix init(pp);
+    SolutionPath path = gridCCDr(P, init, nn, lambdas, params, 0);
+    SparseBlockMatrix betas = path.get(path.size() - 1);
+    double lambda = path.lambda(path.size() - 1);
+
+    std::vector<int> rows, cols, ks;
+    std::vector<double> valij, valji;
+    for(int j = 0; j < pp; ++j){
+        for(int k = 0; k < betas.rowsizes(j); ++k){
+            int i = betas.row(j, k);
+            if(j <= i) continue;
+
+            rows.push_back(i);
+            cols.push_back(j);
+            ks.push_back(k);
+            valij.push_back(betas.value(j, k));
+            valji.push_back(betas.getSiblingValue(j, k));
+        }
+    }
+    printf("Estimate: %d nodes, %d edges, lambda = %.4f\n", pp, betas.activeSetSize(), lambda);
+
+    //
+    // updateBlock: rewrite every block of the estimate with its own values
+    //
+    const int rounds = 200;
+    double sum = 0;
+    std::size_t before = allocations;
+    clock_t start = clock();
+    for(int it = 0; it < rounds; ++it){
+        for(std::size_t n = 0; n < rows.size(); ++n){
+            BlockDelta err = betas.updateBlock(cols[n], ks[n], valij[n] * (it & 1), valji[n] * (it & 1));
+            sum += err.ij + err.ji;
+        }
+    }
+    double t = seconds(start);
+    printf("updateBlock: %.3g calls/s, %.3g allocations per call (checksum = %.6g)\n",
+           rounds * rows.size() / t, static_cast<double>(allocations - before) / (rounds * rows.size()), sum);
+
+    //
+    // addBlock: rebuild the estimate from scratch; only the growth of the columns should allocate
+    //
+    const int builds = 20;
+    before = allocations;
+    std::size_t constructed = 0;
+    start = clock();
+    for(int it = 0; it < builds; ++it){
+        std::size_t empty = allocations;
+        SparseBlockMatrix built(pp);
+        constructed += allocations - empty;
+
+        for(std::size_t n = 0; n < rows.size(); ++n){
+            BlockDelta err = built.addBlock(rows[n], cols[n], valij[n], valji[n]);
+            sum += err.ij + err.ji;
+        }
+    }
+    t = seconds(start);
+    printf("addBlock: %.3g calls/s, %.3g allocations per call (besides the empty matrix)\n",
+           builds * rows.size() / t, static_cast<double>(allocations - before - constructed) / (builds * rows.size()));
+
+    //
+    // Sweeps of concaveCDInit over all pairs, and passes of concaveCD over the active set. The caches are created up
+    //  front, as in singleCCDrInPlace, and the edge threshold is lifted so that every sweep visits all of the pairs.
+    //  The first few sweeps are not counted, since they may still change the structure of betas.
+    //
+    PenaltyFunction mcp(2.0);
+    CCDrAlgorithm alg(100, 1e-4, pp, pp);
+    CycleChecker ccs(betas);
+    EdgeLossCache losses(pp, lambda);
+    SigmaUpdater sigmas(pp);
+    for(int it = 0; it < 3; ++it){
+        concaveCDInit(lambda, nn, betas, alg, ccs, NULL, NULL, &losses, &sigmas, mcp, P, 0);
+    }
+
+    const int sweeps = 5;
+    before = allocations;
+    start = clock();
+    for(int it = 0; it < sweeps; ++it){
+        concaveCDInit(lambda, nn, betas, alg, ccs, NULL, NULL, &losses, &sigmas, mcp, P, 0);
+    }
+    t = seconds(start);
+    printf("concaveCDInit: %.3g sweeps/s, %.3g allocations per sweep (%.0f pairs per sweep)\n",
+           sweeps / t, static_cast<double>(allocations - before) / sweeps, 0.5 * pp * (pp - 1));
+
+    const int passes = 50;
+    before = allocations;
+    start = clock();
+    for(int it = 0; it < passes; ++it){
+        concaveCD(lambda, nn, betas, alg, NULL, NULL, &losses, &sigmas, NULL, mcp, P, 0);
+    }
+    t = seconds(start);
+    printf("concaveCD: %.3g passes/s, %.3g allocations per pass\n", passes / t, static_cast<double>(allocations - before) / passes);
+
+    return 0;
+}
@@ -0,0 +1,172 @@
+//
+// Throughput of the two storage layouts of SparseBlockMatrix (see STORAGE in SparseBlockMatrix.h)
+//
+//   Builds a realistic estimate with gridCCDr, and then times the operations of the CCDr algorithm that depend on
+//   the layout: passes of concaveCD over the active set (with and without the gradient cache), building the
+//   matrix block by block with addBlock, and copying it (e.g. for a snapshot of the estimate). Compile the same
+//   file once for each layout and compare:
+//
+//       g++ -O2 -D_CCDR_STANDALONE_ -I src benchmarks/sbm_layout.cpp -o sbm_arena
+//       g++ -O2 -D_CCDR_STANDALONE_ -D_SBM_VECTORS_ -I src benchmarks/sbm_layout.cpp -o sbm_vectors
+//       ./sbm_arena [pp] [nn] && ./sbm_vectors [pp] [nn]
+//
+//   Both layouts must print the same checksums.
+//
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "algorithm.h"
+#include "correlations.h"
+
+// Deterministic random numbers (xorshift), so that both builds see the same data
+static uint64_t state = 88172645463325252ULL;
+
+double runif(){
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return (state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double rnorm(){
+    return sqrt(-2.0 * log(runif() + 1e-300)) * cos(6.283185307179586 * runif());
+}
+
+double seconds(clock_t start){
+    return static_cast<double>(clock() - start) / CLOCKS_PER_SEC;
+}
+
+double checksum(const SparseBlockMatrix& betas){
+    double sum = 0;
+    for(int j = 0; j < betas.dim(); ++j){
+        for(int k = 0; k < betas.rowsizes(j); ++k){
+            sum += betas.value(j, k) * (1 + betas.row(j, k) + 3 * j);
+        }
+    }
+
+    return sum;
+}
+
+int main(int argc, char** argv){
+    int pp = (argc > 1) ? atoi(argv[1]) : 1000;
+    int nn = (argc > 2) ? atoi(argv[2]) : 200;
+
+    #ifdef _SBM_ARENA_
+        printf("Layout: arena\n");
+    #else
+        printf("Layout: vectors\n");
+    #endif
+
+    //
+    // Random sparse DAG with ~2 parents per node, sampled in topological order
+    //
+    std::vector<double> X(static_cast<std::size_t>(nn) * pp);
+    for(int j = 0; j < pp; ++j){
+        for(int r = 0; r < nn; ++r) X[r + j * nn] = rnorm();
+        for(int i = 0; i < j; ++i){
+            if(runif() >= 2.0 / pp) continue;
+
+            double b = (runif() < 0.5 ? -1 : 1) * (0.5 + 1.5 * runif());
+            for(int r = 0; r < nn; ++r) X[r + j * nn] += b * X[r + i * nn];
+        }
+    }
+
+    std::vector<double> cors(static_cast<std::size_t>(pp) * (pp + 1) / 2);
+    packedCorrelations(&X[0], nn, pp, &cors[0], 1);
+    PackedSymmetricMatrix P(&cors[0], pp);
+
+    //
+    // Estimate at the end of a short grid of lambdas
+    //
+    std::vector<double> lambdas, params;
+    for(int l = 0; l < 10; ++l) lambdas.push_back(sqrt(static_cast<double>(nn)) * pow(0.1, l / 9.0));
+    params.push_back(2.0);
+    params.push_back(1e-4);
+    params.push_back(2 * std::max(10.0, sqrt(static_cast<double>(pp))));
+    params.push_back(10);
+
+    clock_t start = clock();
+    SparseBlockMatrix init(pp);
+    SolutionPath path = gridCCDr(P, init, nn, lambdas, params, 0);
+    printf("gridCCDr: %.3fs\n", seconds(start));
+
+    SparseBlockMatrix betas = path.get(path.size() - 1);
+    double lambda = path.lambda(path.size() - 1);
+
+    std::vector<int> rows, cols;
+    std::vector<double> valij, valji;
+    for(int j = 0; j < pp; ++j){
+        for(int k = 0; k < betas.rowsizes(j); ++k){
+            int i = betas.row(j, k);
+            if(j <= i) continue;
+
+            rows.push_back(i);
+            cols.push_back(j);
+            valij.push_back(betas.value(j, k));
+            valji.push_back(betas.getSiblingValue(j, k));
+        }
+    }
+    printf("Estimate: %d nodes, %d edges, lambda = %.4f, checksum = %.10g\n", pp, betas.activeSetSize(), lambda, checksum(betas));
+
+    //
+    // concaveCD passes over the active set
+    //
+    PenaltyFunction mcp(2.0);
+    const int passes = 50;
+
+    for(int cached = 0; cached <= 1; ++cached){
+        SparseBlockMatrix work = betas;
+        CCDrAlgorithm alg(100, 1e-4, 10, pp);
+        GradientCache grad(pp);
+        GradientCache* gptr = (cached && grad.rebuild(work, P)) ? &grad : NULL;
+
+        start = clock();
+        for(int it = 0; it < passes; ++it){
+            concaveCD(lambda, nn, work, alg, NULL, gptr, NULL, NULL, NULL, mcp, P, 0);
+        }
+        double t = seconds(start);
+
+        printf("concaveCD (%s): %.1f passes/s, %.3g block updates/s, checksum = %.10g\n",
+               gptr == NULL ? "singleUpdate" : "gradient cache", passes / t, alg.getUpdates() / t, checksum(work));
+    }
+
+    //
+    // addBlock: rebuild the estimate from scratch, one block at a time in random order
+    //
+    for(std::size_t n = rows.size(); n > 1; --n){
+        std::size_t m = static_cast<std::size_t>(runif() * n);
+        std::swap(rows[n - 1], rows[m]);
+        std::swap(cols[n - 1], cols[m]);
+        std::swap(valij[n - 1], valij[m]);
+        std::swap(valji[n - 1], valji[m]);
+    }
+
+    const int builds = 20;
+    double sum = 0;
+    start = clock();
+    for(int it = 0; it < builds; ++it){
+        SparseBlockMatrix built(pp);
+        for(std::size_t n = 0; n < rows.size(); ++n){
+            built.addBlock(rows[n], cols[n], valij[n], valji[n]);
+        }
+        sum += built.activeSetSize();
+    }
+    double t = seconds(start);
+    printf("addBlock: %.3g blocks/s (%.0f blocks per build)\n", builds * rows.size() / t, sum / builds);
+
+    //
+    // Copies (snapshots of the estimate)
+    //
+    const int copies = 200;
+    sum = 0;
+    start = clock();
+    for(int it = 0; it < copies; ++it){
+        SparseBlockMatrix copy = betas;
+        sum += copy.rowsizes(it % pp);
+    }
+    t = seconds(start);
+    printf("copy: %.1f copies/s\n", copies / t);
+
+    return 0;
+}
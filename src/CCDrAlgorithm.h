@@ -11,6 +11,7 @@
 
 #include <vector>
 #include <math.h>
+#include <time.h>
 
 #include "defines.h"
 
@@ -36,6 +37,8 @@
 //
 //   numSweeps = the total number of sweeps run so far
 //   maxAbsError = the total accumulated error from each single parameter update run so far
+//   numIters, numUpdates = the total number of passes over the active set (concaveCD) and the total number of
+//                          single parameter updates computed so far; these are only reported back to the user
 //
 // There is also a vector called 'stopFlags' which is used to keep track of the various reasons for terminating the
 //   algorithm. We made this a vector so that if new stopping conditions are added (or we want to just keep track
@@ -64,6 +67,9 @@ public:
     // user-defined input
     unsigned int maxIters;  // maximum number of iterations for the algorithm
     double eps;             // convergence threshold
+    int nthreads;           // number of threads used to compute the proposals in concaveCDInit (<= 0 = all cores)
+    bool jacobi;            // if true, the proposals in concaveCDInit are not refreshed during a row and concaveCD updates
+                            //  the active set in parallel batches (see concaveCDInit and concaveCD)
     
     //
     // Constructors
@@ -84,6 +90,11 @@ public:
     void updateError(double e);     // add a value to the error term
     void resetError();              // reset the error term (maxAbsError) to zero
     void addSweep();                // increment numSweeps
+    void addIter();                 // increment numIters
+    void addUpdates(unsigned long n);   // add n to numUpdates
+    unsigned int getSweeps() const;     // get numSweeps
+    unsigned long getIters() const;     // get numIters
+    unsigned long getUpdates() const;   // get numUpdates
     
 private:
     // 
@@ -100,6 +111,10 @@ private:
     // thresholds
     unsigned int numSweeps; // to keep track of how many full sweeps we have performed, including each check of the active set
     double maxAbsError;     // to store the error from each iteration of the CCDr algorithm
+
+    // counters
+    unsigned long numIters;     // number of calls to concaveCD
+    unsigned long numUpdates;   // number of single parameter updates
     
 };
 
@@ -107,10 +122,14 @@ private:
 CCDrAlgorithm::CCDrAlgorithm(unsigned int m, double e, double a, unsigned int p){
     maxIters = m;
     eps = e;
+    nthreads = 1;
+    jacobi = false;
     alpha = a;
     maxEdges = round(a * p);
     numSweeps = 0;
     maxAbsError = 0;
+    numIters = 0;
+    numUpdates = 0;
     stopFlags = std::vector<int>(2, 0);
 }
 
@@ -209,4 +228,61 @@ void CCDrAlgorithm::addSweep(){
     numSweeps++;
 }
 
+void CCDrAlgorithm::addIter(){
+    numIters++;
+}
+
+void CCDrAlgorithm::addUpdates(unsigned long n){
+    numUpdates += n;
+}
+
+unsigned int CCDrAlgorithm::getSweeps() const{
+    return numSweeps;
+}
+
+unsigned long CCDrAlgorithm::getIters() const{
+    return numIters;
+}
+
+unsigned long CCDrAlgorithm::getUpdates() const{
+    return numUpdates;
+}
+
+//
+// Counters reported back to the caller of singleCCDr (see CCDrAlgorithm)
+//
+// The times are wall clock times in seconds (see now); sigmaSeconds is the part of seconds spent recomputing the
+//   sigmas (see SigmaUpdater.h).
+//
+struct CCDrCounters{
+    unsigned long sweeps;           // complete sweeps (concaveCDInit)
+    unsigned long iters;            // passes over the active set (concaveCD)
+    unsigned long updates;          // single parameter updates
+    unsigned long sigmas;           // sigmas recomputed
+    unsigned long sigmasSkipped;    // sigmas skipped since their column had not changed
+    double seconds;                 // time spent in singleCCDr
+    double sigmaSeconds;            // time spent recomputing the sigmas
+
+    CCDrCounters(){
+        sweeps = 0;
+        iters = 0;
+        updates = 0;
+        sigmas = 0;
+        sigmasSkipped = 0;
+        seconds = 0;
+        sigmaSeconds = 0;
+    }
+
+    static double now();
+};
+
+// Wall clock time (in seconds) from an arbitrary starting point; falls back to the processor time without OpenMP
+inline double CCDrCounters::now(){
+    #ifdef _OPENMP
+        return omp_get_wtime();
+    #else
+        return static_cast<double>(clock()) / CLOCKS_PER_SEC;
+    #endif
+}
+
 #endif
@@ -0,0 +1,155 @@
+//
+//  CoordinateOrder.h
+//  ccdr_proj
+//
+
+#ifndef CoordinateOrder_h
+#define CoordinateOrder_h
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+
+//------------------------------------------------------------------------------/
+//   COORDINATE ORDER CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Decides the order in which concaveCD visits the blocks of the active set. Three policies are available:
+//
+//   1) CYCLIC: Down each column in turn (j = 0, ..., pp-1; k in rows[j]); this is the original order and is handled
+//               by concaveCD itself.
+//   2) RANDOM: A new uniformly random permutation of the blocks for every pass. The generator is seeded with a
+//               fixed value for each call to singleCCDr, so the results are reproducible.
+//   3) GREEDY: Gauss-Southwell style: the blocks are visited in decreasing order of the magnitude of their last
+//               update (|change in beta_ij| + |change in beta_ji|), so that the blocks that are still moving are
+//               updated first. Blocks that have never been updated come first. The order is obtained from a
+//               max-heap keyed on these priorities.
+//
+// The blocks are identified by (column j, sparse row k) with j > row(j, k), as in concaveCD. The sparse row indices
+//   change when betas is compacted or a removed block is added back (see SparseBlockMatrix::compact), so the
+//   priorities are stored along with the row index of each block and matched up with the rows of betas in build.
+//
+class CoordinateOrder{
+
+public:
+    enum Policy { CYCLIC = 0, RANDOM = 1, GREEDY = 2 };
+
+    //
+    // Constructors
+    //
+    CoordinateOrder(int pp, Policy policy = CYCLIC);
+
+    //
+    // Member functions
+    //
+    Policy policy() const;
+    void build(const SparseBlockMatrix& betas);     // order the blocks of betas for the next pass (RANDOM / GREEDY)
+    std::size_t size() const;                       // number of blocks in the current order
+    int column(std::size_t n) const;                // the nth block is (row(column, index), column)
+    int index(std::size_t n) const;
+    void updated(int j, int k, double change);      // record the size of the last update of block (j, k)
+
+private:
+    Policy pol;
+    uint64_t state;                                         // state of the random number generator (xorshift64*)
+    std::vector< std::vector< std::pair<int, double> > > priorities;   // priorities[j][k] = (row(j, k), size of the last update of (j, k))
+    std::vector<double> byRow;                              // scratch space for build (HUGE_VAL between calls)
+    std::vector< std::pair<int, double> > matched;
+    std::vector< std::pair<double, std::pair<int, int> > > heap;
+    std::vector<int> cols, idx;
+
+    uint64_t nextRandom();
+};
+
+CoordinateOrder::CoordinateOrder(int pp, Policy policy){
+    pol = policy;
+    state = 88172645463325252ULL;
+    priorities.resize(pp);
+    if(pol == GREEDY) byRow.assign(pp, HUGE_VAL);
+}
+
+CoordinateOrder::Policy CoordinateOrder::policy() const{
+    return pol;
+}
+
+inline uint64_t CoordinateOrder::nextRandom(){
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 2685821657736338717ULL;
+}
+
+void CoordinateOrder::build(const SparseBlockMatrix& betas){
+    cols.clear();
+    idx.clear();
+
+    if(pol == GREEDY){
+        heap.clear();
+        for(int j = 0; j < betas.dim(); ++j){
+            // Blocks added since the last pass have not been updated yet, so they get the highest priority
+            for(std::size_t r = 0; r < priorities[j].size(); ++r) byRow[priorities[j][r].first] = priorities[j][r].second;
+
+            matched.clear();
+            for(int k = 0; k < betas.rowsizes(j); ++k) matched.push_back(std::make_pair(betas.row(j, k), byRow[betas.row(j, k)]));
+
+            for(std::size_t r = 0; r < priorities[j].size(); ++r) byRow[priorities[j][r].first] = HUGE_VAL;
+            priorities[j].swap(matched);
+
+            for(int k = 0; k < betas.rowsizes(j); ++k){
+                if(j <= betas.row(j, k)) continue;
+
+                // Ties (e.g. all of the new blocks) are broken by the cyclic order
+                heap.push_back(std::make_pair(priorities[j][k].second, std::make_pair(-j, -k)));
+            }
+        }
+
+        std::make_heap(heap.begin(), heap.end());
+        while(!heap.empty()){
+            std::pop_heap(heap.begin(), heap.end());
+            cols.push_back(-heap.back().second.first);
+            idx.push_back(-heap.back().second.second);
+            heap.pop_back();
+        }
+    } else{
+        for(int j = 0; j < betas.dim(); ++j){
+            for(int k = 0; k < betas.rowsizes(j); ++k){
+                if(j <= betas.row(j, k)) continue;
+
+                cols.push_back(j);
+                idx.push_back(k);
+            }
+        }
+
+        if(pol == RANDOM){
+            // Fisher-Yates shuffle
+            for(std::size_t n = cols.size(); n > 1; --n){
+                std::size_t m = nextRandom() % n;
+                std::swap(cols[n - 1], cols[m]);
+                std::swap(idx[n - 1], idx[m]);
+            }
+        }
+    }
+}
+
+std::size_t CoordinateOrder::size() const{
+    return cols.size();
+}
+
+inline int CoordinateOrder::column(std::size_t n) const{
+    return cols[n];
+}
+
+inline int CoordinateOrder::index(std::size_t n) const{
+    return idx[n];
+}
+
+inline void CoordinateOrder::updated(int j, int k, double change){
+    if(pol == GREEDY) priorities[j][k].second = change;
+}
+
+#endif
@@ -0,0 +1,422 @@
+//
+//  CorrelationFile.h
+//  ccdr_proj
+//
+
+#ifndef CorrelationFile_h
+#define CorrelationFile_h
+
+#include <vector>
+#include <string>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+
+#ifndef _WIN32
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+#include "defines.h"
+#include "PackedSymmetricMatrix.h"
+#include "correlations.h"
+
+//------------------------------------------------------------------------------/
+//   CORRELATION FILE CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Binary on-disk storage for the packed correlations, for runs where pp(pp+1)/2 doubles do not fit in RAM
+//   alongside everything else. The file is written once (directly from the data, in bounded memory) and can then
+//   be memory-mapped read-only by as many runs as needed.
+//
+// File format (native byte order):
+//
+//   bytes  0-7    magic number "CCDRCORS"
+//   bytes  8-11   format version (currently 1)
+//   bytes 12-15   byte order mark 0x01020304, used to detect files written on a machine with different endianness
+//   bytes 16-19   memory layout of the values (see PackedSymmetricMatrix::Layout; only PACKED / PACKED_BY_ROW)
+//   bytes 20-23   size of each value in bytes (8 = double, 4 = float)
+//   bytes 24-31   pp = number of nodes
+//   bytes 32-39   nn = number of samples used to compute the correlations
+//   bytes 40-63   reserved (zero)
+//   bytes 64-     the pp*(pp+1)/2 values
+//
+// By default files are written in the PACKED_BY_ROW layout. concaveCDInit visits the pairs (i, j > i) row by row,
+//   so each sweep reads the file from front to back; we tell the kernel as much with madvise(MADV_SEQUENTIAL) so
+//   that it reads ahead and evicts pages behind the sweep rather than faulting in random pages.
+//
+// Files can be written in single precision (see PackedSymmetricMatrixFloat), which halves their size and the
+//   amount of I/O per sweep. Use matrix() for double precision files and matrixFloat() for single precision files.
+//
+// On platforms without mmap (i.e. Windows), the values are simply read into memory.
+//
+
+struct CorrelationFileHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t layout;
+    uint32_t valueSize;
+    uint64_t pp;
+    uint64_t nn;
+    char reserved[24];
+};
+
+class CorrelationFile{
+
+public:
+    //
+    // Constructors / destructor
+    //
+    CorrelationFile(const std::string& path);   // Open and memory-map an existing file
+    ~CorrelationFile();
+
+    //
+    // Accessor functions
+    //
+    bool isOpen() const;                            // returns false if the file could not be opened / validated
+    std::size_t dim() const;                        // number of nodes (pp)
+    unsigned int samples() const;                   // number of samples (nn)
+    PackedSymmetricMatrix::Layout layout() const;   // memory layout of the values in the file
+    bool singlePrecision() const;                   // true if the values are stored as floats
+    PackedSymmetricMatrix matrix() const;           // read-only view of the mapped values (no copy); double files only
+    PackedSymmetricMatrixFloat matrixFloat() const; // read-only view of the mapped values (no copy); float files only
+
+    //
+    // Writers
+    //
+    static bool write(const std::string& path,                  // Compute the correlations of the nn x pp data
+                      const double* X,                          //  matrix X and write them out in blocks of rows
+                      std::size_t nn,                           //  (or columns), without holding the full packed
+                      std::size_t pp,                           //  vector in memory
+                      PackedSymmetricMatrix::Layout layout = PackedSymmetricMatrix::PACKED_BY_ROW,
+                      bool single = false,
+                      int nthreads = 0);
+
+    static bool write(const std::string& path,                  // Write out an existing packed (column-major)
+                      const PackedSymmetricMatrix& cors,        //  correlation vector
+                      std::size_t nn,
+                      PackedSymmetricMatrix::Layout layout = PackedSymmetricMatrix::PACKED_BY_ROW,
+                      bool single = false);
+
+private:
+    CorrelationFileHeader header;
+    bool opened;
+
+    const char* values;             // pointer to the first value (inside the mapping, or into fallback)
+    void* mapping;                  // start of the memory map (NULL if not mapped)
+    std::size_t mappingLength;      // length of the memory map in bytes
+    std::vector<char> fallback;     // used instead of mmap on platforms that do not support it
+
+    static void initHeader(CorrelationFileHeader& h, std::size_t pp, std::size_t nn, PackedSymmetricMatrix::Layout layout, bool single);
+    static bool writeValues(FILE* f, const std::vector<double>& buffer, bool single);
+    bool validHeader(std::size_t fileSize) const;
+
+    // Not copyable: the mapping is owned by this object
+    CorrelationFile(const CorrelationFile&);
+    CorrelationFile& operator=(const CorrelationFile&);
+};
+
+void CorrelationFile::initHeader(CorrelationFileHeader& h, std::size_t pp, std::size_t nn, PackedSymmetricMatrix::Layout layout, bool single){
+    memset(&h, 0, sizeof(CorrelationFileHeader));
+    memcpy(h.magic, "CCDRCORS", 8);
+    h.version = 1;
+    h.byteOrder = 0x01020304;
+    h.layout = static_cast<uint32_t>(layout);
+    h.valueSize = single ? sizeof(float) : sizeof(double);
+    h.pp = pp;
+    h.nn = nn;
+}
+
+bool CorrelationFile::validHeader(std::size_t fileSize) const{
+    if(memcmp(header.magic, "CCDRCORS", 8) != 0){
+        ERROR_OUTPUT << "Not a correlation file: Magic number does not match." << std::endl;
+        return false;
+    }
+    if(header.byteOrder != 0x01020304){
+        ERROR_OUTPUT << "Correlation file was written on a machine with a different byte order." << std::endl;
+        return false;
+    }
+    if(header.version != 1 || (header.valueSize != sizeof(double) && header.valueSize != sizeof(float))){
+        ERROR_OUTPUT << "Unsupported correlation file version or value size." << std::endl;
+        return false;
+    }
+    if(header.layout != PackedSymmetricMatrix::PACKED && header.layout != PackedSymmetricMatrix::PACKED_BY_ROW){
+        ERROR_OUTPUT << "Unsupported layout in correlation file." << std::endl;
+        return false;
+    }
+    if(fileSize < sizeof(CorrelationFileHeader) + PackedSymmetricMatrix::packedLength(header.pp) * header.valueSize){
+        ERROR_OUTPUT << "Correlation file is truncated: Expected " << PackedSymmetricMatrix::packedLength(header.pp) << " values." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// Opens the file, checks the header and maps the values read-only
+CorrelationFile::CorrelationFile(const std::string& path){
+    opened = false;
+    values = NULL;
+    mapping = NULL;
+    mappingLength = 0;
+    memset(&header, 0, sizeof(CorrelationFileHeader));
+
+    #ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0){
+            ERROR_OUTPUT << "Unable to open correlation file: " << path << std::endl;
+            return;
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < sizeof(CorrelationFileHeader)
+           || pread(fd, &header, sizeof(CorrelationFileHeader), 0) != static_cast<ssize_t>(sizeof(CorrelationFileHeader))
+           || !validHeader(static_cast<std::size_t>(st.st_size))){
+            ERROR_OUTPUT << "Invalid correlation file: " << path << std::endl;
+            close(fd);
+            return;
+        }
+
+        mappingLength = static_cast<std::size_t>(st.st_size);
+        mapping = mmap(NULL, mappingLength, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd); // the mapping keeps its own reference to the file
+
+        if(mapping == MAP_FAILED){
+            ERROR_OUTPUT << "Unable to memory-map correlation file: " << path << std::endl;
+            mapping = NULL;
+            return;
+        }
+
+        // A sweep reads a PACKED_BY_ROW file front to back; PACKED files are accessed with long strides
+        #ifdef MADV_SEQUENTIAL
+            if(header.layout == PackedSymmetricMatrix::PACKED_BY_ROW){
+                madvise(mapping, mappingLength, MADV_SEQUENTIAL);
+            }
+        #endif
+
+        values = static_cast<const char*>(mapping) + sizeof(CorrelationFileHeader);
+    #else
+        FILE* f = fopen(path.c_str(), "rb");
+        if(f == NULL){
+            ERROR_OUTPUT << "Unable to open correlation file: " << path << std::endl;
+            return;
+        }
+
+        fseek(f, 0, SEEK_END);
+        std::size_t fileSize = static_cast<std::size_t>(ftell(f));
+        fseek(f, 0, SEEK_SET);
+
+        if(fread(&header, sizeof(CorrelationFileHeader), 1, f) != 1 || !validHeader(fileSize)){
+            ERROR_OUTPUT << "Invalid correlation file: " << path << std::endl;
+            fclose(f);
+            return;
+        }
+
+        fallback.resize(PackedSymmetricMatrix::packedLength(header.pp) * header.valueSize);
+        if(!fallback.empty() && fread(&fallback[0], 1, fallback.size(), f) != fallback.size()){
+            ERROR_OUTPUT << "Unable to read correlation file: " << path << std::endl;
+            fclose(f);
+            return;
+        }
+        fclose(f);
+
+        values = fallback.empty() ? NULL : &fallback[0];
+    #endif
+
+    opened = true;
+}
+
+CorrelationFile::~CorrelationFile(){
+    #ifndef _WIN32
+        if(mapping != NULL) munmap(mapping, mappingLength);
+    #endif
+}
+
+bool CorrelationFile::isOpen() const{
+    return opened;
+}
+
+std::size_t CorrelationFile::dim() const{
+    return static_cast<std::size_t>(header.pp);
+}
+
+unsigned int CorrelationFile::samples() const{
+    return static_cast<unsigned int>(header.nn);
+}
+
+PackedSymmetricMatrix::Layout CorrelationFile::layout() const{
+    return static_cast<PackedSymmetricMatrix::Layout>(header.layout);
+}
+
+bool CorrelationFile::singlePrecision() const{
+    return header.valueSize == sizeof(float);
+}
+
+// NOTE: The returned objects point into the mapping, so they must not outlive this CorrelationFile
+PackedSymmetricMatrix CorrelationFile::matrix() const{
+    if(singlePrecision()){
+        ERROR_OUTPUT << "Correlation file is stored in single precision: Use matrixFloat() instead." << std::endl;
+    }
+
+    return PackedSymmetricMatrix(reinterpret_cast<const double*>(values), dim(), layout(), layout());
+}
+
+PackedSymmetricMatrixFloat CorrelationFile::matrixFloat() const{
+    if(!singlePrecision()){
+        ERROR_OUTPUT << "Correlation file is stored in double precision: Use matrix() instead." << std::endl;
+    }
+
+    return PackedSymmetricMatrixFloat(reinterpret_cast<const float*>(values), dim(), layout(), layout());
+}
+
+// Writes out a block of values, converting to single precision if requested
+bool CorrelationFile::writeValues(FILE* f, const std::vector<double>& buffer, bool single){
+    if(buffer.empty()) return true;
+
+    if(single){
+        std::vector<float> converted(buffer.begin(), buffer.end());
+        return fwrite(&converted[0], sizeof(float), converted.size(), f) == converted.size();
+    } else{
+        return fwrite(&buffer[0], sizeof(double), buffer.size(), f) == buffer.size();
+    }
+}
+
+//
+// Writes the correlations of X to path one block of _CORS_TILE_SIZE_ rows (PACKED_BY_ROW) or columns (PACKED) at a
+//   time. Each block is a contiguous range of the output, so only O(pp * _CORS_TILE_SIZE_) values are ever held in
+//   memory on top of the standardized copy of X. The tiles within a block are computed in parallel.
+//
+bool CorrelationFile::write(const std::string& path,
+                            const double* X,
+                            std::size_t nn,
+                            std::size_t pp,
+                            PackedSymmetricMatrix::Layout layout,
+                            bool single,
+                            int nthreads){
+    if(layout != PackedSymmetricMatrix::PACKED && layout != PackedSymmetricMatrix::PACKED_BY_ROW){
+        ERROR_OUTPUT << "Correlation files must use either the PACKED or PACKED_BY_ROW layout." << std::endl;
+        return false;
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if(f == NULL){
+        ERROR_OUTPUT << "Unable to open file for writing: " << path << std::endl;
+        return false;
+    }
+
+    CorrelationFileHeader h;
+    initHeader(h, pp, nn, layout, single);
+    bool ok = (fwrite(&h, sizeof(CorrelationFileHeader), 1, f) == 1);
+
+    std::vector<double> Z;
+    std::vector<int> zeroVariance = standardizeColumns(X, nn, pp, Z);
+
+    const std::size_t T = _CORS_TILE_SIZE_;
+    const std::size_t numTiles = (pp + T - 1) / T;
+    bool byRow = (layout == PackedSymmetricMatrix::PACKED_BY_ROW);
+
+    #ifdef _OPENMP
+        if(nthreads <= 0) nthreads = omp_get_max_threads();
+    #endif
+
+    std::vector<double> buffer;
+    for(std::size_t K = 0; K < numTiles && ok; ++K){
+        // The block of rows (or columns) K covers [kStart, kEnd) and the output range [offset, offset + length)
+        std::size_t kStart = K * T, kEnd = std::min(kStart + T, pp);
+        std::size_t offset, length;
+        if(byRow){
+            offset = PackedSymmetricMatrix::rowPackedIndex(kStart, kStart, pp);
+            length = PackedSymmetricMatrix::rowPackedIndex(kEnd - 1, pp - 1, pp) + 1 - offset;
+        } else{
+            offset = PackedSymmetricMatrix::packedIndex(0, kStart);
+            length = PackedSymmetricMatrix::packedIndex(kEnd - 1, kEnd - 1) + 1 - offset;
+        }
+        buffer.resize(length);
+
+        // Tiles (K, L) for L >= K in a block of rows, or (L, K) for L <= K in a block of columns
+        long first = byRow ? static_cast<long>(K) : 0;
+        long last = byRow ? static_cast<long>(numTiles) : static_cast<long>(K) + 1;
+
+        #ifdef _OPENMP
+        #pragma omp parallel num_threads(nthreads)
+        #endif
+        {
+            std::vector<double> tile(T * T);
+
+            #ifdef _OPENMP
+            #pragma omp for schedule(dynamic)
+            #endif
+            for(long L = first; L < last; ++L){
+                std::size_t I = byRow ? K : static_cast<std::size_t>(L);
+                std::size_t J = byRow ? static_cast<std::size_t>(L) : K;
+                std::size_t aStart = I * T, aEnd = std::min(aStart + T, pp);
+                std::size_t bStart = J * T, bEnd = std::min(bStart + T, pp);
+
+                gramTile(Z, nn, aStart, aEnd, bStart, bEnd, tile);
+
+                for(std::size_t b = bStart; b < bEnd; ++b){
+                    std::size_t aLast = (I == J) ? b : aEnd - 1;
+                    for(std::size_t a = aStart; a <= aLast; ++a){
+                        std::size_t idx = byRow ? PackedSymmetricMatrix::rowPackedIndex(a, b, pp) : PackedSymmetricMatrix::packedIndex(a, b);
+                        buffer[idx - offset] = tileCorrelation(tile, zeroVariance, a, aStart, b, bStart);
+                    }
+                }
+            }
+        }
+
+        ok = writeValues(f, buffer, single);
+    }
+
+    if(fclose(f) != 0) ok = false;
+    if(!ok) ERROR_OUTPUT << "Error while writing correlation file: " << path << std::endl;
+
+    return ok;
+}
+
+//
+// Writes an existing set of correlations to path, one row (PACKED_BY_ROW) or column (PACKED) at a time
+//
+bool CorrelationFile::write(const std::string& path,
+                            const PackedSymmetricMatrix& cors,
+                            std::size_t nn,
+                            PackedSymmetricMatrix::Layout layout,
+                            bool single){
+    if(layout != PackedSymmetricMatrix::PACKED && layout != PackedSymmetricMatrix::PACKED_BY_ROW){
+        ERROR_OUTPUT << "Correlation files must use either the PACKED or PACKED_BY_ROW layout." << std::endl;
+        return false;
+    }
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if(f == NULL){
+        ERROR_OUTPUT << "Unable to open file for writing: " << path << std::endl;
+        return false;
+    }
+
+    std::size_t pp = cors.dim();
+    CorrelationFileHeader h;
+    initHeader(h, pp, nn, layout, single);
+    bool ok = (fwrite(&h, sizeof(CorrelationFileHeader), 1, f) == 1);
+
+    std::vector<double> buffer;
+    buffer.reserve(pp);
+    for(std::size_t k = 0; k < pp && ok; ++k){
+        buffer.clear();
+        if(layout == PackedSymmetricMatrix::PACKED_BY_ROW){
+            for(std::size_t b = k; b < pp; ++b) buffer.push_back(cors.value(k, b));
+        } else{
+            for(std::size_t a = 0; a <= k; ++a) buffer.push_back(cors.value(a, k));
+        }
+
+        ok = writeValues(f, buffer, single);
+    }
+
+    if(fclose(f) != 0) ok = false;
+    if(!ok) ERROR_OUTPUT << "Error while writing correlation file: " << path << std::endl;
+
+    return ok;
+}
+
+#endif
@@ -0,0 +1,484 @@
+//
+//  CycleChecker.h
+//  ccdr_proj
+//
+
+#ifndef CycleChecker_h
+#define CycleChecker_h
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+#include <stdint.h>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+
+//------------------------------------------------------------------------------/
+//   CYCLE CHECKER CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Answers the question "does adding the edge a -> b induce a cycle in the DAG represented by betas?" for
+//   concaveCDInit, which asks it up to twice for every pair of nodes in each sweep.
+//
+// Adding a -> b induces a cycle if and only if b is an ancestor of a. Instead of searching the ancestors of a
+//   every time, the checker maintains a topological order of the current DAG (i.e. ord[i] < ord[j] whenever
+//   i -> j is an edge), using the online algorithm of Pearce & Kelly (2006):
+//
+//   1) If ord[a] < ord[b], then b cannot be an ancestor of a, and the edge is accepted in O(1) time. This is
+//       by far the most common case.
+//   2) Otherwise, only the ancestors x of a with ord[b] <= ord[x] can lead back to b, so the breadth-first search
+//       over the parents of a from the original checkCycleSparse (see Fei's paper) is restricted to this window.
+//   3) When an edge a -> b with ord[a] > ord[b] is actually added to the model (see addEdge), the nodes inside
+//       the window that are reachable from b (forward) or that reach a (backward) are reordered among their own
+//       positions so that the ancestors of a come first. Nothing outside of the window is touched.
+//
+// Removing an edge never invalidates a topological order, so edges can be zeroed out (e.g. by concaveCD) without
+//   updating the order. Since concaveCDInit is the only place where edges are added to the model, it calls
+//   addEdge after every block that ends up with a nonzero edge (via addBlock or updateBlock), and removeEdge after
+//   every edge it zeroes out (which only matters for the reachability cache below).
+//
+// The scratch space (queue, visited marks, reorder buffers) is allocated once and sized to betas.dim(). Instead
+//   of clearing the visited marks, each search uses a new epoch number and a node counts as visited only if its
+//   mark equals the current epoch, so a search only touches the nodes it actually visits.
+//
+// The order is computed from the initial betas when the checker is created. If the initial betas are not
+//   acyclic, the order is disabled and every query falls back to the unrestricted search.
+//
+// REACHABILITY CACHE: Within one sweep of concaveCDInit, the same node a is queried against many different b while
+//   the graph only changes occasionally. For queries that are not settled by the order, the checker therefore keeps
+//   a bitset of the ancestors of a (bit b is set iff b is an ancestor of a), so that the query is a single bit test.
+//   The bitsets are built lazily: anc(a) is the OR of {p} and anc(p) over the parents p of a, computed one 64-bit
+//   word at a time for every uncached ancestor of a in topological order. While the sweep is running, the cache
+//   is kept consistent with the graph:
+//
+//   -adding a -> b: every cached descendant d of b (i.e. d = b or bit b is set in anc(d)) gets anc(a) and a OR'ed
+//     into anc(d) (or is dropped from the cache if anc(a) itself is not cached)
+//   -removing a -> b: every cached descendant of b is dropped from the cache, since it may have lost ancestors
+//
+// Edges removed outside of concaveCDInit (i.e. by concaveCD) are not reported, so the whole cache is dropped at the
+//   start of each sweep (see newSweep), which is O(1) thanks to the same epoch trick as the visited marks. The
+//   bitsets take pp^2 / 8 bytes; if that is more than _CYCLE_CACHE_MB_ megabytes, the cache is disabled and the
+//   restricted search is used instead.
+//
+// The counters orderHits(), cacheHits() and cacheMisses() report how the queries were answered (searches() counts
+//   the queries that had to search the graph because the cache is disabled).
+//
+class CycleChecker{
+
+public:
+    //
+    // Constructors
+    //
+    CycleChecker(const SparseBlockMatrix& betas);   // order the nodes of the DAG represented by betas
+
+    //
+    // Member functions
+    //
+    bool hasCycle(const SparseBlockMatrix& betas,    // returns true if adding the edge a -> b to betas
+                  int a,                             //  induces a cycle
+                  int b);
+    void addEdge(const SparseBlockMatrix& betas,     // restores the topological order after the edge a -> b
+                 int a,                              //  has been added to betas (a -> b must not induce a cycle)
+                 int b);
+    void removeEdge(int b);                          // drops the bitsets made stale by removing an edge a -> b
+    void newSweep();                                 // drops all cached bitsets
+    bool ordered() const;                            // false if the topological order is disabled
+    bool cacheEnabled() const;                       // false if the bitsets would not fit into _CYCLE_CACHE_MB_
+    int dim() const;                                 // number of nodes the scratch space is sized for
+
+    //
+    // Counters
+    //
+    std::size_t orderHits() const;                   // queries settled by the topological order
+    std::size_t cacheHits() const;                   // queries settled by a cached bitset
+    std::size_t cacheMisses() const;                 // queries that had to build a bitset first
+    std::size_t searches() const;                    // queries that searched the graph (cache disabled)
+
+private:
+    std::vector<int> ord;                   // ord[i] = position of node i in the topological order
+    bool hasOrder;
+
+    std::vector<unsigned int> visited;      // visited[i] == epoch <=> node i has been visited by the current search
+    std::vector<int> queue;                 // nodes waiting to be searched
+    unsigned int epoch;
+
+    std::vector< std::pair<int, int> > deltaF, deltaB;     // (ord, node) pairs to be reordered by addEdge
+    std::vector<int> positions;
+
+    //
+    // Reachability cache: the bitset of node i is anc[i * words] ... anc[(i + 1) * words - 1], and it is valid iff
+    //   cached[i] == sweep. The bitsets are only allocated on the first miss.
+    //
+    bool useCache;
+    std::size_t words;
+    std::vector<uint64_t> anc;
+    std::vector<unsigned int> cached;
+    unsigned int sweep;
+
+    std::size_t nOrder, nHits, nMisses, nSearches;
+
+    void newEpoch();
+    void sortOrder(const SparseBlockMatrix& betas);
+    bool search(const SparseBlockMatrix& betas, int a, int b);
+    void buildAncestors(const SparseBlockMatrix& betas, int a);
+
+    bool isCached(int i) const;
+    bool testBit(int i, int b) const;
+    uint64_t* bits(int i);
+};
+
+// dst |= src, one word at a time (a plain loop, so that the compiler can vectorize it)
+inline void orWords(uint64_t* dst, const uint64_t* src, std::size_t n){
+    for(std::size_t w = 0; w < n; ++w){
+        dst[w] |= src[w];
+    }
+}
+
+CycleChecker::CycleChecker(const SparseBlockMatrix& betas){
+    int pp = betas.dim();
+
+    ord.assign(pp, 0);
+    visited.assign(pp, 0);
+    queue.assign(pp, 0);
+    epoch = 0;
+
+    sortOrder(betas);
+
+    words = (static_cast<std::size_t>(pp) + 63) / 64;
+    useCache = hasOrder && (static_cast<double>(pp) * words * sizeof(uint64_t) <= _CYCLE_CACHE_MB_ * 1048576.0);
+    cached.assign(pp, 0);
+    sweep = 1;
+
+    nOrder = 0;
+    nHits = 0;
+    nMisses = 0;
+    nSearches = 0;
+}
+
+bool CycleChecker::ordered() const{
+    return hasOrder;
+}
+
+bool CycleChecker::cacheEnabled() const{
+    return useCache;
+}
+
+std::size_t CycleChecker::orderHits() const{
+    return nOrder;
+}
+
+std::size_t CycleChecker::cacheHits() const{
+    return nHits;
+}
+
+std::size_t CycleChecker::cacheMisses() const{
+    return nMisses;
+}
+
+std::size_t CycleChecker::searches() const{
+    return nSearches;
+}
+
+inline bool CycleChecker::isCached(int i) const{
+    return cached[i] == sweep;
+}
+
+inline bool CycleChecker::testBit(int i, int b) const{
+    return (anc[i * words + (b >> 6)] >> (b & 63)) & 1;
+}
+
+inline uint64_t* CycleChecker::bits(int i){
+    return &anc[i * words];
+}
+
+//
+// newSweep
+//
+//   Drops all cached bitsets by moving on to a new sweep number (the marks are only cleared when it wraps around).
+//
+void CycleChecker::newSweep(){
+    if(++sweep == 0){
+        cached.assign(cached.size(), 0);
+        sweep = 1;
+    }
+}
+
+int CycleChecker::dim() const{
+    return static_cast<int>(visited.size());
+}
+
+//
+// newEpoch
+//
+//   Starts a new search. The marks only need to be cleared when the epoch counter wraps around, i.e. once every
+//   ~4 billion searches.
+//
+inline void CycleChecker::newEpoch(){
+    if(++epoch == 0){
+        visited.assign(visited.size(), 0);
+        epoch = 1;
+    }
+}
+
+//
+// sortOrder
+//
+//   Computes the initial topological order with Kahn's algorithm. Note that rows[j] holds both the parents of j
+//   (value(j, k) != 0) and its children (getSiblingValue(j, k) != 0).
+//
+void CycleChecker::sortOrder(const SparseBlockMatrix& betas){
+    int pp = betas.dim();
+
+    // Use ord to count the parents of each node that have not been placed yet
+    int nBot = 0, nTop = 0;
+    for(int j = 0; j < pp; ++j){
+        ord[j] = 0;
+        for(int k = 0; k < betas.rowsizes(j); ++k){
+            if(fabs(betas.value(j, k)) > ZERO_THRESH) ord[j]++;
+        }
+
+        if(ord[j] == 0) queue[nTop++] = j;
+    }
+
+    while(nBot < nTop){
+        int i = queue[nBot++];
+
+        for(int k = 0; k < betas.rowsizes(i); ++k){
+            if(fabs(betas.getSiblingValue(i, k)) > ZERO_THRESH){
+                int j = betas.row(i, k);
+                if(--ord[j] == 0) queue[nTop++] = j;
+            }
+        }
+    }
+
+    // Every node has been placed iff betas is acyclic
+    hasOrder = (nTop == pp);
+    for(int n = 0; n < pp; ++n){
+        ord[queue[n]] = n;
+    }
+}
+
+//
+// hasCycle
+//
+//   Output: false = no cycle induced, true = cycle is induced
+//
+bool CycleChecker::hasCycle(const SparseBlockMatrix& betas,
+                            int a,
+                            int b
+                            ){
+    if(a == b) return true;
+
+    // Case (1): the edge respects the current order
+    if(hasOrder && ord[a] < ord[b]){
+        ++nOrder;
+        return false;
+    }
+
+    if(!useCache){
+        ++nSearches;
+        return search(betas, a, b);
+    }
+
+    if(isCached(a)){
+        ++nHits;
+    } else{
+        ++nMisses;
+        buildAncestors(betas, a);
+    }
+
+    return testBit(a, b);
+}
+
+//
+// search
+//
+//   Case (2) above: the breadth-first search over the ancestors of a, skipping those that come before b in the
+//   order.
+//
+//   NOTES:
+//     -every node enters the queue at most once, so the queue never holds more than dim() nodes
+//
+bool CycleChecker::search(const SparseBlockMatrix& betas,
+                          int a,
+                          int b
+                          ){
+    int lb = hasOrder ? ord[b] : 0;
+
+    newEpoch();
+
+    int nBot = 0, nTop = 0;
+    visited[a] = epoch;
+    queue[nTop++] = a;
+
+    while(nBot < nTop){
+        int i = queue[nBot++];
+
+        for(int k = 0; k < betas.rowsizes(i); ++k){
+            int j = betas.row(i, k);
+
+            if(fabs(betas.value(i, k)) > ZERO_THRESH){
+                if(j == b){
+                    return true;
+                } else if(visited[j] != epoch && (!hasOrder || ord[j] > lb)){
+                    visited[j] = epoch;
+                    queue[nTop++] = j;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+//
+// buildAncestors
+//
+//   Computes the bitset of a, along with the bitsets of all of its ancestors that are not cached yet. These are
+//   collected by a search over the parents that stops at cached nodes, and then built in topological order so
+//   that the bitsets of the parents of a node are always ready before the node itself.
+//
+void CycleChecker::buildAncestors(const SparseBlockMatrix& betas, int a){
+    if(anc.empty()) anc.assign(cached.size() * words, 0);
+
+    newEpoch();
+    deltaB.clear();
+
+    int nTop = 0;
+    visited[a] = epoch;
+    queue[nTop++] = a;
+    while(nTop > 0){
+        int i = queue[--nTop];
+        deltaB.push_back(std::make_pair(ord[i], i));
+
+        for(int k = 0; k < betas.rowsizes(i); ++k){
+            int j = betas.row(i, k);
+            if(fabs(betas.value(i, k)) > ZERO_THRESH && visited[j] != epoch && !isCached(j)){
+                visited[j] = epoch;
+                queue[nTop++] = j;
+            }
+        }
+    }
+
+    std::sort(deltaB.begin(), deltaB.end());
+
+    for(std::size_t n = 0; n < deltaB.size(); ++n){
+        int i = deltaB[n].second;
+        uint64_t* bi = bits(i);
+        std::fill(bi, bi + words, static_cast<uint64_t>(0));
+
+        for(int k = 0; k < betas.rowsizes(i); ++k){
+            if(fabs(betas.value(i, k)) > ZERO_THRESH){
+                int j = betas.row(i, k);
+                orWords(bi, bits(j), words);
+                bi[j >> 6] |= static_cast<uint64_t>(1) << (j & 63);
+            }
+        }
+
+        cached[i] = sweep;
+    }
+}
+
+//
+// addEdge
+//
+//   Case (3) above: if the new edge a -> b violates the order, the affected window ord[b] ... ord[a] is searched
+//   forward from b (deltaF) and backward from a (deltaB). The positions held by these nodes are then handed out
+//   again, first to deltaB and then to deltaF, each in their previous relative order.
+//
+//   Before that, the cached descendants of b are patched (see the notes on the reachability cache above).
+//
+void CycleChecker::addEdge(const SparseBlockMatrix& betas,
+                           int a,
+                           int b
+                           ){
+    if(useCache && !anc.empty()){
+        bool patch = isCached(a);
+        for(int d = 0; d < dim(); ++d){
+            if(isCached(d) && (d == b || testBit(d, b))){
+                if(patch){
+                    orWords(bits(d), bits(a), words);
+                    bits(d)[a >> 6] |= static_cast<uint64_t>(1) << (a & 63);
+                } else{
+                    cached[d] = 0;
+                }
+            }
+        }
+    }
+
+    if(!hasOrder || ord[a] < ord[b]) return;
+
+    int lb = ord[b], ub = ord[a];
+
+    newEpoch();
+    deltaF.clear();
+    deltaB.clear();
+
+    // Forward search from b over the children with ord < ub (a itself is not reachable since a -> b is acyclic)
+    int nTop = 0;
+    visited[b] = epoch;
+    queue[nTop++] = b;
+    while(nTop > 0){
+        int i = queue[--nTop];
+        deltaF.push_back(std::make_pair(ord[i], i));
+
+        for(int k = 0; k < betas.rowsizes(i); ++k){
+            int j = betas.row(i, k);
+            if(fabs(betas.getSiblingValue(i, k)) > ZERO_THRESH && visited[j] != epoch && ord[j] < ub){
+                visited[j] = epoch;
+                queue[nTop++] = j;
+            }
+        }
+    }
+
+    // Backward search from a over the parents with ord > lb
+    visited[a] = epoch;
+    queue[nTop++] = a;
+    while(nTop > 0){
+        int i = queue[--nTop];
+        deltaB.push_back(std::make_pair(ord[i], i));
+
+        for(int k = 0; k < betas.rowsizes(i); ++k){
+            int j = betas.row(i, k);
+            if(fabs(betas.value(i, k)) > ZERO_THRESH && visited[j] != epoch && ord[j] > lb){
+                visited[j] = epoch;
+                queue[nTop++] = j;
+            }
+        }
+    }
+
+    std::sort(deltaF.begin(), deltaF.end());
+    std::sort(deltaB.begin(), deltaB.end());
+
+    // Pool the positions held by the affected nodes...
+    positions.clear();
+    for(std::size_t n = 0; n < deltaB.size(); ++n) positions.push_back(deltaB[n].first);
+    for(std::size_t n = 0; n < deltaF.size(); ++n) positions.push_back(deltaF[n].first);
+    std::sort(positions.begin(), positions.end());
+
+    // ...and reassign them so that every ancestor of a comes before every descendant of b
+    std::size_t p = 0;
+    for(std::size_t n = 0; n < deltaB.size(); ++n) ord[deltaB[n].second] = positions[p++];
+    for(std::size_t n = 0; n < deltaF.size(); ++n) ord[deltaF[n].second] = positions[p++];
+}
+
+//
+// removeEdge
+//
+//   Called after an edge a -> b has been removed from betas. The topological order is still valid, but the cached
+//   descendants of b may have lost some ancestors, so they are dropped from the cache. Which parent a was removed
+//   does not matter, so only b is passed.
+//
+void CycleChecker::removeEdge(int b){
+    if(!useCache || anc.empty()) return;
+
+    for(int d = 0; d < dim(); ++d){
+        if(isCached(d) && (d == b || testBit(d, b))){
+            cached[d] = 0;
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,388 @@
+//
+//  DataStream.h
+//  ccdr_proj
+//
+
+#ifndef DataStream_h
+#define DataStream_h
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "defines.h"
+#include "correlations.h"
+
+//------------------------------------------------------------------------------/
+//   STREAMING DATA READERS
+//------------------------------------------------------------------------------/
+
+//
+// Readers for data files that are too large (or too slow) to load into R as a data.frame first. The rows are read
+//   in chunks of at most _STREAM_CHUNK_ROWS_ rows, checked for missing / non-numeric values as they are read, and
+//   folded into the running sufficient statistics (see updateComoments in correlations.h). The file is therefore
+//   read exactly once, and only one chunk of rows is ever held in memory on top of the pp*(pp+1)/2 co-moments.
+//
+// Two formats are supported:
+//
+//   1) CsvDataStream: Delimited text with one row per line and an optional header line (which is skipped). The
+//                      number of columns is taken from the first line. Fields may be quoted. Empty fields, NA and
+//                      NaN are reported as missing values; anything else that does not parse as a number is an
+//                      error.
+//   2) BinaryDataStream: Raw doubles in native byte order, stored column by column (as in an R matrix) with no
+//                         header, so the dimensions must be supplied by the caller. NaN values (which includes
+//                         NA_real_) are reported as missing values.
+//
+// On error, a message is written to ERROR_OUTPUT and streamSufficientStats returns false.
+//
+
+class DataStream{
+
+public:
+    virtual ~DataStream(){}
+
+    virtual bool isOpen() const = 0;                // returns false if the file could not be opened
+    virtual std::size_t columns() const = 0;        // number of columns (pp)
+
+    //
+    // Reads up to maxRows rows into chunk (row-major, i.e. chunk[r * columns() + j] is the jth value in row r) and
+    //   returns the number of rows read in rows (zero once the end of the file has been reached).
+    //
+    // Output: false if the chunk contains a missing / invalid value or the file could not be read
+    //
+    virtual bool readRows(std::size_t maxRows, std::vector<double>& chunk, std::size_t& rows) = 0;
+};
+
+//
+// Delimited text files
+//
+class CsvDataStream : public DataStream{
+
+public:
+    CsvDataStream(const std::string& path, bool header = true, char sep = ',');
+    ~CsvDataStream();
+
+    bool isOpen() const;
+    std::size_t columns() const;
+    bool readRows(std::size_t maxRows, std::vector<double>& chunk, std::size_t& rows);
+
+private:
+    FILE* file;
+    char sep;
+    std::size_t pp;
+    std::size_t lineNumber;         // for error messages
+
+    std::vector<char> buffer;       // raw bytes read from the file
+    std::size_t bufferPos, bufferEnd;
+    std::string line;               // current line
+    bool pendingLine;               // true if line has been read (to count the columns) but not parsed yet
+
+    bool nextLine();
+    std::size_t countFields() const;
+    bool parseLine(double* values);
+
+    // Not copyable: the FILE handle is owned by this object
+    CsvDataStream(const CsvDataStream&);
+    CsvDataStream& operator=(const CsvDataStream&);
+};
+
+CsvDataStream::CsvDataStream(const std::string& path, bool header, char sep_){
+    sep = sep_;
+    pp = 0;
+    lineNumber = 0;
+    bufferPos = 0;
+    bufferEnd = 0;
+    pendingLine = false;
+    buffer.resize(1 << 16);
+
+    file = fopen(path.c_str(), "rb");
+    if(file == NULL){
+        ERROR_OUTPUT << "Unable to open data file: " << path << std::endl;
+        return;
+    }
+
+    // The number of columns is taken from the first line; if this is not a header, keep it for the first chunk
+    if(nextLine()){
+        pp = countFields();
+        pendingLine = !header;
+    }
+}
+
+CsvDataStream::~CsvDataStream(){
+    if(file != NULL) fclose(file);
+}
+
+bool CsvDataStream::isOpen() const{
+    return file != NULL;
+}
+
+std::size_t CsvDataStream::columns() const{
+    return pp;
+}
+
+// Reads the next non-empty line into line (without the line ending); returns false at the end of the file
+bool CsvDataStream::nextLine(){
+    line.clear();
+
+    for(;;){
+        if(bufferPos == bufferEnd){
+            bufferEnd = fread(&buffer[0], 1, buffer.size(), file);
+            bufferPos = 0;
+            if(bufferEnd == 0) break;
+        }
+
+        char* start = &buffer[0] + bufferPos;
+        char* newline = static_cast<char*>(memchr(start, '\n', bufferEnd - bufferPos));
+        if(newline == NULL){
+            line.append(start, bufferEnd - bufferPos);
+            bufferPos = bufferEnd;
+            continue;
+        }
+
+        line.append(start, newline - start);
+        bufferPos += (newline - start) + 1;
+        ++lineNumber;
+
+        if(!line.empty() && line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+        if(!line.empty()) return true;
+    }
+
+    // Last line without a trailing newline
+    if(!line.empty()){
+        ++lineNumber;
+        if(line[line.size() - 1] == '\r') line.erase(line.size() - 1);
+    }
+
+    return !line.empty();
+}
+
+std::size_t CsvDataStream::countFields() const{
+    std::size_t fields = 1;
+    bool quoted = false;
+    for(std::size_t i = 0; i < line.size(); ++i){
+        if(line[i] == '"') quoted = !quoted;
+        else if(line[i] == sep && !quoted) ++fields;
+    }
+
+    return fields;
+}
+
+//
+// parseLine
+//
+//   Parses the current line into pp values; reports the first field that is missing or not a number
+//
+bool CsvDataStream::parseLine(double* values){
+    const char* p = line.c_str();
+
+    for(std::size_t j = 0; j < pp; ++j){
+        while(*p == ' ' || *p == '\t') ++p;
+
+        bool quoted = (*p == '"');
+        if(quoted) ++p;
+
+        char* end;
+        double v = strtod(p, &end);
+        bool parsed = (end != p);
+        p = end;
+
+        if(quoted && *p == '"') ++p;
+        while(*p == ' ' || *p == '\t') ++p;
+
+        if(!parsed || v != v){
+            // strtod accepts "NaN"; NA and empty fields do not parse at all
+            ERROR_OUTPUT << "Missing or non-numeric value in line " << lineNumber << ", column " << j + 1 << "." << std::endl;
+            return false;
+        }
+
+        if(j + 1 < pp){
+            if(*p != sep){
+                ERROR_OUTPUT << "Line " << lineNumber << " has " << j + 1 << " columns, expected " << pp << "." << std::endl;
+                return false;
+            }
+            ++p;
+        }
+
+        values[j] = v;
+    }
+
+    if(*p != '\0'){
+        ERROR_OUTPUT << "Line " << lineNumber << " has more than " << pp << " columns." << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool CsvDataStream::readRows(std::size_t maxRows, std::vector<double>& chunk, std::size_t& rows){
+    chunk.resize(maxRows * pp);
+    rows = 0;
+
+    while(rows < maxRows){
+        if(pendingLine){
+            pendingLine = false;
+        } else if(!nextLine()){
+            break;
+        }
+
+        if(!parseLine(&chunk[0] + rows * pp)) return false;
+        ++rows;
+    }
+
+    return true;
+}
+
+//
+// Raw column-major binary files
+//
+class BinaryDataStream : public DataStream{
+
+public:
+    BinaryDataStream(const std::string& path, std::size_t nn, std::size_t pp);
+    ~BinaryDataStream();
+
+    bool isOpen() const;
+    std::size_t columns() const;
+    bool readRows(std::size_t maxRows, std::vector<double>& chunk, std::size_t& rows);
+
+private:
+    FILE* file;
+    std::size_t nn, pp;
+    std::size_t nextRow;            // first row that has not been read yet
+    std::vector<double> column;     // one column of the current chunk
+
+    bool seek(std::size_t offset);
+
+    // Not copyable: the FILE handle is owned by this object
+    BinaryDataStream(const BinaryDataStream&);
+    BinaryDataStream& operator=(const BinaryDataStream&);
+};
+
+BinaryDataStream::BinaryDataStream(const std::string& path, std::size_t nn_, std::size_t pp_){
+    nn = nn_;
+    pp = pp_;
+    nextRow = 0;
+
+    file = fopen(path.c_str(), "rb");
+    if(file == NULL){
+        ERROR_OUTPUT << "Unable to open data file: " << path << std::endl;
+        return;
+    }
+
+    // Check that the file holds exactly nn * pp doubles
+    bool sizeOk = seek(nn * pp * sizeof(double)) && fgetc(file) == EOF;
+    if(sizeOk && nn * pp > 0){
+        sizeOk = seek(nn * pp * sizeof(double) - 1) && fgetc(file) != EOF;
+    }
+
+    if(!sizeOk){
+        ERROR_OUTPUT << "Size of data file does not match the dimensions: Expected " << nn << " x " << pp << " doubles." << std::endl;
+        fclose(file);
+        file = NULL;
+    }
+}
+
+BinaryDataStream::~BinaryDataStream(){
+    if(file != NULL) fclose(file);
+}
+
+bool BinaryDataStream::isOpen() const{
+    return file != NULL;
+}
+
+std::size_t BinaryDataStream::columns() const{
+    return pp;
+}
+
+// 64-bit safe fseek
+bool BinaryDataStream::seek(std::size_t offset){
+    #ifdef _WIN32
+        return _fseeki64(file, static_cast<__int64>(offset), SEEK_SET) == 0;
+    #else
+        return fseeko(file, static_cast<off_t>(offset), SEEK_SET) == 0;
+    #endif
+}
+
+//
+// readRows
+//
+//   Since the file is stored column by column, each chunk of rows is read as pp contiguous segments (one per
+//   column) and transposed into the row-major chunk.
+//
+bool BinaryDataStream::readRows(std::size_t maxRows, std::vector<double>& chunk, std::size_t& rows){
+    rows = std::min(maxRows, nn - nextRow);
+    chunk.resize(rows * pp);
+    column.resize(rows);
+
+    for(std::size_t j = 0; j < pp && rows > 0; ++j){
+        if(!seek((j * nn + nextRow) * sizeof(double)) || fread(&column[0], sizeof(double), rows, file) != rows){
+            ERROR_OUTPUT << "Unable to read column " << j + 1 << " of the data file." << std::endl;
+            return false;
+        }
+
+        for(std::size_t r = 0; r < rows; ++r){
+            if(column[r] != column[r]){
+                ERROR_OUTPUT << "Missing value in row " << nextRow + r + 1 << ", column " << j + 1 << "." << std::endl;
+                return false;
+            }
+            chunk[r * pp + j] = column[r];
+        }
+    }
+
+    nextRow += rows;
+
+    return true;
+}
+
+//
+// streamSufficientStats
+//
+//   Reads the whole stream and folds it into the running sufficient statistics (nn, means, comoments), which may
+//   already contain the statistics of earlier data with the same columns. If means / comoments are empty, they are
+//   initialized to zero.
+//
+//   Output: false if the data could not be read (the statistics are then incomplete and should be discarded)
+//
+bool streamSufficientStats(DataStream& in,
+                           std::size_t& nn,
+                           std::vector<double>& means,
+                           std::vector<double>& comoments,
+                           std::size_t chunkRows = _STREAM_CHUNK_ROWS_,
+                           int nthreads = 0){
+    if(!in.isOpen()) return false;
+
+    std::size_t pp = in.columns();
+    if(means.empty() && comoments.empty()){
+        means.assign(pp, 0);
+        comoments.assign(pp * (pp + 1) / 2, 0);
+    } else if(means.size() != pp || comoments.size() != pp * (pp + 1) / 2){
+        ERROR_OUTPUT << "Number of columns in the data (" << pp << ") does not match the sufficient statistics." << std::endl;
+        return false;
+    }
+
+    std::vector<double> chunk, X;
+    std::size_t rows;
+    for(;;){
+        if(!in.readRows(chunkRows, chunk, rows)) return false;
+        if(rows == 0) break;
+
+        // updateComoments expects a column-major block of rows
+        X.resize(rows * pp);
+        for(std::size_t r = 0; r < rows; ++r){
+            for(std::size_t j = 0; j < pp; ++j){
+                X[j * rows + r] = chunk[r * pp + j];
+            }
+        }
+
+        updateComoments(&X[0], rows, pp, nn, &means[0], &comoments[0], nthreads);
+        nn += rows;
+    }
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,147 @@
+//
+//  EdgeColouring.h
+//  ccdr_proj
+//
+
+#ifndef EdgeColouring_h
+#define EdgeColouring_h
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+
+//------------------------------------------------------------------------------/
+//   EDGE COLOURING CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Splits the blocks of betas into batches of blocks that can be updated concurrently by concaveCD. The update of the
+//   block (i, j) reads and writes only columns i and j of betas (and sigma_i, sigma_j), so two blocks conflict iff they
+//   share a node. A batch of blocks without common nodes is a matching in the skeleton of betas, and a partition of
+//   the blocks into such batches is a proper edge colouring of the skeleton.
+//
+// The colouring is computed greedily: the blocks are visited in the same order as the serial sweep of concaveCD
+//   (j = 0, ..., pp-1; i = row(j, k) < j), and each block gets the smallest colour that is not yet used at either of
+//   its two nodes. This uses at most 2 * maxdeg - 1 colours, and the batches are returned in order of their colour,
+//   each in the order of the serial sweep. The colouring only depends on betas, so a sweep over the batches gives
+//   the same result for any number of threads.
+//
+// The colours used at each node are stored as a bitset, so build takes O(rowsizes(i) + rowsizes(j)) / 64 work per
+//   block.
+//
+class EdgeColouring{
+
+public:
+    //
+    // Constructors
+    //
+    EdgeColouring(int pp);
+
+    //
+    // Member functions
+    //
+    void build(const SparseBlockMatrix& betas);     // colour the blocks of betas
+    int batches() const;                            // number of colours
+    int batchSize(int c) const;                     // number of blocks with colour c
+    int column(int c, int n) const;                 // the nth block with colour c is (row(column, index), column)
+    int index(int c, int n) const;
+
+private:
+    int pp;
+    int ncolours;
+    std::vector< std::vector<uint64_t> > used;      // used[i] = bitset of the colours used at node i
+    std::vector<int> blockColumns, blockIndices;    // blocks in the order of the serial sweep
+    std::vector<int> blockColours;
+    std::vector<int> offsets;                       // blocks with colour c are in [offsets[c], offsets[c + 1])
+    std::vector<int> cols, idx;                     // blocks sorted by colour
+
+    int firstFree(int i, int j) const;
+    void setUsed(int i, int c);
+};
+
+EdgeColouring::EdgeColouring(int pp_){
+    pp = pp_;
+    ncolours = 0;
+    used.resize(pp);
+    offsets.assign(1, 0);
+}
+
+// Smallest colour that is used at neither i nor j
+int EdgeColouring::firstFree(int i, int j) const{
+    std::size_t words = std::max(used[i].size(), used[j].size());
+    for(std::size_t w = 0; w < words; ++w){
+        uint64_t taken = (w < used[i].size() ? used[i][w] : 0) | (w < used[j].size() ? used[j][w] : 0);
+        if(~taken == 0) continue;
+
+        int bit = 0;
+        while((taken >> bit) & 1) ++bit;
+        return static_cast<int>(w) * 64 + bit;
+    }
+
+    return static_cast<int>(words) * 64;
+}
+
+void EdgeColouring::setUsed(int i, int c){
+    std::size_t w = c >> 6;
+    if(used[i].size() <= w) used[i].resize(w + 1, 0);
+    used[i][w] |= static_cast<uint64_t>(1) << (c & 63);
+}
+
+void EdgeColouring::build(const SparseBlockMatrix& betas){
+    for(int i = 0; i < pp; ++i) used[i].clear();
+    blockColumns.clear();
+    blockIndices.clear();
+    blockColours.clear();
+    ncolours = 0;
+
+    for(int j = 0; j < pp; ++j){
+        for(int k = 0; k < betas.rowsizes(j); ++k){
+            int i = betas.row(j, k);
+            if(j <= i) continue; // each block is visited once, as in concaveCD
+
+            int c = firstFree(i, j);
+            setUsed(i, c);
+            setUsed(j, c);
+
+            blockColumns.push_back(j);
+            blockIndices.push_back(k);
+            blockColours.push_back(c);
+            ncolours = std::max(ncolours, c + 1);
+        }
+    }
+
+    // Counting sort by colour (stable, so each batch stays in the order of the serial sweep)
+    offsets.assign(ncolours + 1, 0);
+    for(std::size_t b = 0; b < blockColours.size(); ++b) offsets[blockColours[b] + 1]++;
+    for(int c = 0; c < ncolours; ++c) offsets[c + 1] += offsets[c];
+
+    cols.resize(blockColumns.size());
+    idx.resize(blockColumns.size());
+    std::vector<int> next(offsets.begin(), offsets.end() - 1);
+    for(std::size_t b = 0; b < blockColours.size(); ++b){
+        int pos = next[blockColours[b]]++;
+        cols[pos] = blockColumns[b];
+        idx[pos] = blockIndices[b];
+    }
+}
+
+int EdgeColouring::batches() const{
+    return ncolours;
+}
+
+int EdgeColouring::batchSize(int c) const{
+    return offsets[c + 1] - offsets[c];
+}
+
+inline int EdgeColouring::column(int c, int n) const{
+    return cols[offsets[c] + n];
+}
+
+inline int EdgeColouring::index(int c, int n) const{
+    return idx[offsets[c] + n];
+}
+
+#endif
@@ -0,0 +1,123 @@
+//
+//  EdgeLossCache.h
+//  ccdr_proj
+//
+
+#ifndef EdgeLossCache_h
+#define EdgeLossCache_h
+
+#include <vector>
+#include <math.h>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+#include "PenaltyFunction.h"
+
+//------------------------------------------------------------------------------/
+//   EDGE LOSS CACHE CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Caches the terms of the penalized loss of each column that computeEdgeLoss needs for S[0] (the value of the loss
+//   of column b with beta_ab = 0):
+//
+//          quadratic(b) = beta_b' Sigma beta_b         = \sum_{m, n in rows(b)} <xm,xn> * beta_mb * beta_nb
+//          linear(b)    = <Sigma beta_b, e_b>          = \sum_{m in rows(b)} <xm,xb> * beta_mb
+//          penalty(b)   = \sum_{m in rows(b)} p(|beta_mb|)
+//
+// Computing quadratic(b) directly takes O(rowsizes(b)^2) work, and concaveCDInit calls computeEdgeLoss twice for
+//   every pair it visits, i.e. once for each of the pp - 1 pairs that involve b, although these terms only change
+//   when column b does. With the cache, S[0] is obtained from these terms by removing the contribution of beta_ab,
+//   which takes O(rowsizes(b)) work (see computeEdgeLoss).
+//
+// Whenever column b of betas changes (a value in the column, or a new block in the column), the terms are marked as
+//   stale (see columnChanged) and recomputed on the next call to refresh. The terms do not depend on sigma_b, so
+//   changing sigma_b does not invalidate them.
+//
+class EdgeLossCache{
+
+public:
+    //
+    // Constructors
+    //
+    EdgeLossCache(int pp, double lambda);
+
+    //
+    // Member functions
+    //
+    template <typename CorMatrix>
+    void refresh(int b,                                 // recompute the terms of column b if they are stale
+                 const SparseBlockMatrix& betas,
+                 const PenaltyFunction& pen,
+                 const CorMatrix& cors);
+    void columnChanged(int b);                          // mark the terms of column b as stale
+
+    double quadratic(int b) const;
+    double linear(int b) const;
+    double penalty(int b) const;
+    std::size_t refreshes() const;                      // number of columns recomputed so far
+
+private:
+    double lambda;
+    std::vector<double> quad, lin, pen;
+    std::vector<char> stale;
+    std::size_t nRefreshes;
+};
+
+EdgeLossCache::EdgeLossCache(int pp, double lambda_){
+    lambda = lambda_;
+    quad.assign(pp, 0);
+    lin.assign(pp, 0);
+    pen.assign(pp, 0);
+    stale.assign(pp, 1);
+    nRefreshes = 0;
+}
+
+template <typename CorMatrix>
+inline void EdgeLossCache::refresh(int b, const SparseBlockMatrix& betas, const PenaltyFunction& penalty, const CorMatrix& cors){
+    if(!stale[b]) return;
+
+    double q = 0, l = 0, p = 0;
+    for(int m = 0; m < betas.rowsizes(b); ++m){
+        int row_m = betas.row(b, m);
+        double beta_m = betas.value(b, m);
+
+        // Only the upper triangle of the (symmetric) quadratic form is summed
+        double qm = 0;
+        for(int n = 0; n < m; ++n){
+            qm += cors.value(row_m, betas.row(b, n)) * betas.value(b, n);
+        }
+        q += beta_m * (2.0 * qm + cors.value(row_m, row_m) * beta_m);
+
+        l += cors.value(row_m, b) * beta_m;
+        p += penalty.p(fabs(beta_m), lambda);
+    }
+
+    quad[b] = q;
+    lin[b] = l;
+    pen[b] = p;
+    stale[b] = 0;
+    ++nRefreshes;
+}
+
+inline void EdgeLossCache::columnChanged(int b){
+    stale[b] = 1;
+}
+
+inline double EdgeLossCache::quadratic(int b) const{
+    return quad[b];
+}
+
+inline double EdgeLossCache::linear(int b) const{
+    return lin[b];
+}
+
+inline double EdgeLossCache::penalty(int b) const{
+    return pen[b];
+}
+
+std::size_t EdgeLossCache::refreshes() const{
+    return nRefreshes;
+}
+
+#endif
@@ -0,0 +1,137 @@
+//
+//  GradientCache.h
+//  ccdr_proj
+//
+
+#ifndef GradientCache_h
+#define GradientCache_h
+
+#include <vector>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+
+//------------------------------------------------------------------------------/
+//   GRADIENT CACHE CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Caches the partial products Sigma * beta_b (where Sigma is the correlation matrix and beta_b is column b of betas)
+//   that are needed by the single parameter updates in concaveCD. Without the cache, every call to singleResidual
+//   loops over all of the rows of column b, so each coordinate update costs O(deg(b)).
+//
+// For each column b and each sparse row k (i.e. each block (a, b) with a = row(b, k)), the cache stores
+//
+//          partial(b, k) = \sum_{r in rows(b)} <xr,xa> * beta_rb,
+//
+//   so that the residual factor of a -> b (see singleResidual) is simply
+//
+//          res_ab = sigma_b * <xa,xb> - (partial(b, k) - <xa,xa> * beta_ab),
+//
+//   which is O(1). When beta_rb changes by delta, partial(b, k) changes by <xr,xa> * delta for each k, so each write
+//   costs O(rowsizes(b)); writes of zero (i.e. coordinates that did not move, which is most of them once the
+//   algorithm is close to convergence) are free. This is the covariance update of Friedman et al. (2010) for the
+//   lasso, restricted to the rows of each column that concaveCD actually visits.
+//
+// concaveCDInit changes the structure of betas (addBlock), so the cache is rebuilt from scratch before each block of
+//   calls to concaveCD (see rebuild); concaveCD then keeps it up to date with every call to updateBlock (see
+//   columnChanged). Rebuilding also keeps the rounding error of the incremental updates from accumulating.
+//
+// The cache takes one double per sparse row of betas. If that is more than _GRADIENT_CACHE_MB_ megabytes, the cache
+//   is not built and concaveCD falls back to singleUpdate (see rebuild).
+//
+class GradientCache{
+
+public:
+    //
+    // Constructors
+    //
+    GradientCache(int pp);
+
+    //
+    // Member functions
+    //
+    template <typename CorMatrix>
+    bool rebuild(const SparseBlockMatrix& betas,    // recompute all of the partial products; returns false if they
+                 const CorMatrix& cors);            //  would not fit into _GRADIENT_CACHE_MB_
+
+    template <typename CorMatrix>
+    double residual(int b, int k,                   // residual factor res_ab for a = row(b, k), in O(1)
+                    const SparseBlockMatrix& betas,
+                    const CorMatrix& cors) const;
+
+    template <typename CorMatrix>
+    void columnChanged(int b, int k, double delta,  // beta_ab (a = row(b, k)) has changed by delta
+                       const SparseBlockMatrix& betas,
+                       const CorMatrix& cors);
+
+    std::size_t rebuilds() const;                   // number of calls to rebuild so far
+
+private:
+    int pp;
+    std::vector<std::size_t> offsets;   // partial(b, k) = partials[offsets[b] + k]
+    std::vector<double> partials;
+    std::size_t nRebuilds;
+};
+
+GradientCache::GradientCache(int pp_){
+    pp = pp_;
+    nRebuilds = 0;
+    offsets.assign(pp + 1, 0);
+}
+
+template <typename CorMatrix>
+bool GradientCache::rebuild(const SparseBlockMatrix& betas, const CorMatrix& cors){
+    std::size_t total = 0;
+    for(int b = 0; b < pp; ++b){
+        offsets[b] = total;
+        total += betas.rowsizes(b);
+    }
+    offsets[pp] = total;
+
+    if(total * sizeof(double) > _GRADIENT_CACHE_MB_ * 1048576.0) return false;
+
+    partials.assign(total, 0);
+    for(int b = 0; b < pp; ++b){
+        double* col = &partials[0] + offsets[b];
+
+        for(int m = 0; m < betas.rowsizes(b); ++m){
+            double beta = betas.value(b, m);
+            if(beta == 0) continue;
+
+            int row_m = betas.row(b, m);
+            for(int k = 0; k < betas.rowsizes(b); ++k){
+                col[k] += cors.value(row_m, betas.row(b, k)) * beta;
+            }
+        }
+    }
+
+    ++nRebuilds;
+
+    return true;
+}
+
+template <typename CorMatrix>
+inline double GradientCache::residual(int b, int k, const SparseBlockMatrix& betas, const CorMatrix& cors) const{
+    int a = betas.row(b, k);
+
+    // The sum in singleResidual excludes the term r = a
+    return betas.sigma(b) * cors.value(a, b) - (partials[offsets[b] + k] - cors.value(a, a) * betas.value(b, k));
+}
+
+template <typename CorMatrix>
+inline void GradientCache::columnChanged(int b, int k, double delta, const SparseBlockMatrix& betas, const CorMatrix& cors){
+    if(delta == 0) return;
+
+    int a = betas.row(b, k);
+    double* col = &partials[0] + offsets[b];
+    for(int m = 0; m < betas.rowsizes(b); ++m){
+        col[m] += cors.value(a, betas.row(b, m)) * delta;
+    }
+}
+
+std::size_t GradientCache::rebuilds() const{
+    return nRebuilds;
+}
+
+#endif
@@ -0,0 +1,147 @@
+//
+//  KKTCache.h
+//  ccdr_proj
+//
+
+#ifndef KKTCache_h
+#define KKTCache_h
+
+#include <vector>
+#include <limits>
+#include <math.h>
+
+#include "defines.h"
+
+//------------------------------------------------------------------------------/
+//   KKT CACHE CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Lets concaveCDInit skip the pairs that are certain to stay zero since the last time they were visited. Each call
+//   to singleCCDr runs several sweeps of concaveCDInit, but usually only a handful of columns change in between, so
+//   most pairs would just compute the same two zero updates again. Every call to singleCCDr uses a cache for its own
+//   sweeps (this includes ccdr.run, which calls singleCCDr from R once per lambda), but only gridCCDr keeps one cache
+//   for the whole grid, so that the certificates (and the memory) are carried over from one value of lambda to the
+//   next. A new cache knows nothing, so the first sweep of each call to singleCCDr visits every pair.
+//
+// The single parameter update for a -> b is zero iff |res_ab| <= lambda (see singleResidual), and res_ab only depends
+//   on column b of betas (sigma_b and the values beta_ib). Since all of the correlations are bounded by one,
+//
+//          |change in res_ab| <= |change in sigma_b| + \sum_i |change in beta_ib| =: change in drift[b],
+//
+//   where drift[b] is the total absolute change of column b so far (see columnChanged). If a pair was visited when
+//   the drift of column b was D, with margin m = lambda - |res_ab| > 0, then its update is still zero as long as
+//   drift[b] <= D + m. This bound is the certificate stored for each direction of each pair (see certify); a pair
+//   is skipped iff both of its certificates hold. A column that has not changed at all (i.e. a "clean" column)
+//   trivially keeps all of its certificates.
+//
+// When lambda decreases from lambda_0 to lambda_1, the margin m of every pair shrinks by lambda_0 - lambda_1, so the
+//   certificates are stored relative to the total decrease of lambda so far (see setLambda): The cache keeps
+//   D + m - shift_0, and a pair is certified iff drift[b] - shift_1 <= D + m - shift_0, where shift_0 - shift_1 is
+//   the decrease in between. An increase of lambda is ignored rather than credited: it would certify the pairs
+//   with a negative margin, i.e. pairs with a nonzero block that would only be zeroed out by visiting them.
+//
+// Skipping a certified pair is exact: visiting it would compute two zero updates and leave betas unchanged.
+//
+// The certificates take two floats per pair (rounded down, so that they stay conservative), i.e. 4 * pp^2 bytes.
+//   If that is more than _KKT_CACHE_MB_ megabytes, the cache is disabled (see enabled). A cache with pp = 0 does
+//   not allocate anything.
+//
+class KKTCache{
+
+public:
+    //
+    // Constructors
+    //
+    KKTCache(int pp);
+
+    //
+    // Member functions
+    //
+    bool enabled() const;                           // false if the certificates would not fit into _KKT_CACHE_MB_
+    void setLambda(double lambda);                  // value of lambda of the following calls to certified / certify
+    bool certified(int i, int j) const;             // true if both updates for the pair (i, j > i) are still zero
+    void certify(int i, int j,                      // store the certificates of the pair (i, j > i), given the
+                 double marginij, double marginji); //  margins lambda - |res_ij| and lambda - |res_ji|
+    void columnChanged(int j, double delta);        // add |delta| to the drift of column j
+    std::size_t skipped() const;                    // number of pairs skipped so far
+    void addSkipped();
+
+private:
+    int pp;
+    bool useCache;
+    double lambda;
+    double shift;                   // minus the total decrease of lambda so far
+    std::vector<double> drift;      // drift[j] = total absolute change of column j
+    std::vector<float> certs;       // certs[2 * pair(i, j)] for res_ij, certs[2 * pair(i, j) + 1] for res_ji
+    std::size_t nSkipped;
+
+    std::size_t pair(int i, int j) const;
+};
+
+KKTCache::KKTCache(int pp_){
+    pp = pp_;
+    nSkipped = 0;
+    lambda = 0;
+    shift = 0;
+
+    double pairs = 0.5 * pp * (pp - 1.0);
+    useCache = (pairs * 2 * sizeof(float) <= _KKT_CACHE_MB_ * 1048576.0);
+
+    drift.assign(pp, 0);
+    if(useCache){
+        // No pair is certified until it has been visited, whatever the value of lambda
+        certs.assign(static_cast<std::size_t>(pairs) * 2, -std::numeric_limits<float>::infinity());
+    }
+}
+
+bool KKTCache::enabled() const{
+    return useCache;
+}
+
+void KKTCache::setLambda(double lambda_){
+    if(lambda_ < lambda) shift -= lambda - lambda_;
+    lambda = lambda_;
+}
+
+// Index of the pair (i, j > i) in row-major order, so that each row of pairs is contiguous
+inline std::size_t KKTCache::pair(int i, int j) const{
+    return static_cast<std::size_t>(i) * (2 * pp - i - 1) / 2 + (j - i - 1);
+}
+
+inline bool KKTCache::certified(int i, int j) const{
+    std::size_t p = 2 * pair(i, j);
+    return drift[j] - shift <= certs[p] && drift[i] - shift <= certs[p + 1];
+}
+
+//
+// certify
+//
+//   Must be called with the margins of the residuals computed BEFORE the pair is updated, and before the changes
+//   from the update are added to the drift. A margin of -HUGE_VAL does not certify anything.
+//
+//   The float is rounded down (by a relative 1e-6, well above the rounding error of a float) and a small absolute
+//   tolerance covers the rounding error of the residuals themselves.
+//
+inline void KKTCache::certify(int i, int j, double marginij, double marginji){
+    std::size_t p = 2 * pair(i, j);
+
+    double cij = drift[j] + marginij - shift - 1e-10;
+    double cji = drift[i] + marginji - shift - 1e-10;
+    certs[p] = static_cast<float>(cij - fabs(cij) * 1e-6);
+    certs[p + 1] = static_cast<float>(cji - fabs(cji) * 1e-6);
+}
+
+inline void KKTCache::columnChanged(int j, double delta){
+    drift[j] += fabs(delta);
+}
+
+std::size_t KKTCache::skipped() const{
+    return nSkipped;
+}
+
+inline void KKTCache::addSkipped(){
+    ++nSkipped;
+}
+
+#endif
@@ -0,0 +1,207 @@
+//
+//  LazyCorrelationMatrix.h
+//  ccdr_proj
+//
+
+#ifndef LazyCorrelationMatrix_h
+#define LazyCorrelationMatrix_h
+
+#include <vector>
+#include <algorithm>
+
+#include "defines.h"
+#include "correlations.h"
+
+//------------------------------------------------------------------------------/
+//   LAZY CORRELATION MATRIX CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Computes the correlations on demand from the standardized data instead of storing all pp*(pp+1)/2 of them. For
+//   very large pp even a memory-mapped packed vector is prohibitive, while the algorithm only ever revisits the
+//   correlations between the columns in the active set (plus one pass over all pairs per sweep of concaveCDInit).
+//
+// The correlation matrix is divided into the same square tiles of _CORS_TILE_SIZE_ columns that are used by the
+//   correlation builder (see correlations.h). The first time an element of a tile is requested, the whole tile is
+//   computed at once with gramTile (so the dot products run in cache-blocked, vectorizable batches) and kept in a
+//   bounded cache. When the cache is full, the least recently used tile is evicted and its storage is reused.
+//   Cached tiles are found through a direct index over all numTiles*(numTiles+1)/2 tiles (a pointer and a time
+//   stamp per tile, i.e. ~20MB for pp = 100k), so a lookup is just a couple of array accesses.
+//
+// Since concaveCDInit visits the pairs (i, j > i) row by row, a full sweep touches one strip of tiles for every
+//   _CORS_TILE_SIZE_ rows; a cache of at least pp / _CORS_TILE_SIZE_ tiles therefore computes each tile only once
+//   per sweep. Each tile takes _CORS_TILE_SIZE_^2 doubles (32KB with the default tile size).
+//
+// This class provides the same value(a, b) / dim() interface as PackedSymmetricMatrix, so it can be passed to
+//   gridCCDr / singleCCDr (and hence singleUpdate / computeEdgeLoss) in place of the precomputed correlations.
+//
+// NOTE: value() updates the cache, so a LazyCorrelationMatrix must not be shared between threads.
+//
+class LazyCorrelationMatrix{
+
+public:
+    //
+    // Constructors
+    //
+    LazyCorrelationMatrix(const double* X,                      // Standardizes the nn x pp (column-major) data
+                          std::size_t nn,                       //  matrix X; the data is copied, so X need not
+                          std::size_t pp,                       //  outlive this object
+                          std::size_t maxTiles = _LAZY_CORS_CACHE_TILES_);
+
+    //
+    // Accessor functions
+    //
+    double value(std::size_t a, std::size_t b) const;   // get the (a, b) element; the order of a and b does not matter
+    std::size_t dim() const;                            // dimension (i.e. # of nodes)
+    std::size_t samples() const;                        // number of samples (nn)
+    std::size_t cacheSize() const;                      // number of tiles currently in the cache
+    std::size_t cacheHits() const;                      // number of lookups served from the cache
+    std::size_t cacheMisses() const;                    // number of tiles that had to be computed
+
+private:
+    std::size_t nn, pp;
+    std::size_t numTiles;               // number of tiles per row / column
+    std::size_t maxTiles;               // maximum number of tiles held in the cache
+
+    std::vector<double> Z;              // standardized data (see standardizeColumns)
+    std::vector<int> zeroVariance;
+
+    //
+    // The cache is updated by the (logically const) accessor. A tile is identified by its key I + J*(J+1)/2, where
+    //   I <= J are its block row and column. Each slot holds one tile (the output of gramTile) and the key of the
+    //   tile it currently holds.
+    //
+    mutable std::vector< std::vector<double> > slots;
+    mutable std::vector<std::size_t> slotKey;
+    mutable std::vector<const double*> lookup;      // tile key -> cached values (NULL if the tile is not in the cache)
+    mutable std::vector<std::size_t> lastUsed;      // tile key -> time of the most recent lookup
+    mutable std::size_t clock;                      // incremented on every lookup that changes tiles
+    mutable std::size_t lastKey;                    // previous lookup (fast path)
+    mutable const double* lastTile;
+    mutable std::size_t hits, misses;
+
+    const double* tile(std::size_t I, std::size_t J) const;
+    const double* fetchTile(std::size_t key, std::size_t I, std::size_t J) const;
+
+    // Not copyable: lookup points into slots
+    LazyCorrelationMatrix(const LazyCorrelationMatrix&);
+    LazyCorrelationMatrix& operator=(const LazyCorrelationMatrix&);
+};
+
+LazyCorrelationMatrix::LazyCorrelationMatrix(const double* X, std::size_t nn_, std::size_t pp_, std::size_t maxTiles_){
+    nn = nn_;
+    pp = pp_;
+    numTiles = (pp + _CORS_TILE_SIZE_ - 1) / _CORS_TILE_SIZE_;
+
+    // Never allocate more slots than there are tiles
+    maxTiles = std::max(std::min(maxTiles_, numTiles * (numTiles + 1) / 2), static_cast<std::size_t>(1));
+
+    zeroVariance = standardizeColumns(X, nn, pp, Z);
+    lookup.assign(numTiles * (numTiles + 1) / 2, NULL);
+    lastUsed.assign(numTiles * (numTiles + 1) / 2, 0);
+    slots.reserve(maxTiles);
+
+    clock = 0;
+    lastKey = static_cast<std::size_t>(-1);  // not a valid key
+    lastTile = NULL;
+    hits = 0;
+    misses = 0;
+}
+
+//
+// tile
+//
+//   Returns the (I, J) tile. Cache hits are handled inline; computing (and evicting) tiles is left to fetchTile.
+//
+inline const double* LazyCorrelationMatrix::tile(std::size_t I, std::size_t J) const{
+    std::size_t key = I + J * (J + 1) / 2;
+
+    // Consecutive lookups often hit the same tile, in which case there is nothing to update
+    if(key != lastKey){
+        lastTile = lookup[key];
+        if(lastTile == NULL){
+            lastTile = fetchTile(key, I, J);
+        } else{
+            ++hits;
+        }
+
+        lastKey = key;
+        lastUsed[key] = ++clock;
+    } else{
+        ++hits;
+    }
+
+    return lastTile;
+}
+
+//
+// fetchTile
+//
+//   Computes the (I, J) tile and stores it in the cache. New tiles are converted to correlations straight away (see tileCorrelation) so that value() is a plain array access.
+//
+//   When the cache is full, the least recently used slot is overwritten. Finding it takes a linear scan over the
+//   slots, but this is cheap next to the O(nn * _CORS_TILE_SIZE_^2) cost of computing the new tile.
+//
+const double* LazyCorrelationMatrix::fetchTile(std::size_t key, std::size_t I, std::size_t J) const{
+    ++misses;
+
+    std::size_t s;
+    if(slots.size() < maxTiles){
+        s = slots.size();
+        slots.push_back(std::vector<double>(_CORS_TILE_SIZE_ * _CORS_TILE_SIZE_));
+        slotKey.push_back(key);
+    } else{
+        s = 0;
+        for(std::size_t k = 1; k < slots.size(); ++k){
+            if(lastUsed[slotKey[k]] < lastUsed[slotKey[s]]) s = k;
+        }
+
+        lookup[slotKey[s]] = NULL;
+        slotKey[s] = key;
+    }
+
+    std::size_t aStart = I * _CORS_TILE_SIZE_, aEnd = std::min(aStart + _CORS_TILE_SIZE_, pp);
+    std::size_t bStart = J * _CORS_TILE_SIZE_, bEnd = std::min(bStart + _CORS_TILE_SIZE_, pp);
+    std::vector<double>& t = slots[s];
+    gramTile(Z, nn, aStart, aEnd, bStart, bEnd, t);
+
+    for(std::size_t b = bStart; b < bEnd; ++b){
+        std::size_t aLast = (I == J) ? b : aEnd - 1;
+        for(std::size_t a = aStart; a <= aLast; ++a){
+            t[(a - aStart) + (b - bStart) * _CORS_TILE_SIZE_] = tileCorrelation(t, zeroVariance, a, aStart, b, bStart);
+        }
+    }
+
+    lookup[key] = &t[0];
+
+    return lookup[key];
+}
+
+// Returns the (a, b) element; since the matrix is symmetric, (a, b) and (b, a) are the same element
+inline double LazyCorrelationMatrix::value(std::size_t a, std::size_t b) const{
+    if(a > b) std::swap(a, b);
+
+    return tile(a / _CORS_TILE_SIZE_, b / _CORS_TILE_SIZE_)[(a % _CORS_TILE_SIZE_) + (b % _CORS_TILE_SIZE_) * _CORS_TILE_SIZE_];
+}
+
+std::size_t LazyCorrelationMatrix::dim() const{
+    return pp;
+}
+
+std::size_t LazyCorrelationMatrix::samples() const{
+    return nn;
+}
+
+std::size_t LazyCorrelationMatrix::cacheSize() const{
+    return slots.size();
+}
+
+std::size_t LazyCorrelationMatrix::cacheHits() const{
+    return hits;
+}
+
+std::size_t LazyCorrelationMatrix::cacheMisses() const{
+    return misses;
+}
+
+#endif
@@ -0,0 +1,272 @@
+//
+//  PackedSymmetricMatrix.h
+//  ccdr_proj
+//
+
+#ifndef PackedSymmetricMatrix_h
+#define PackedSymmetricMatrix_h
+
+#include <vector>
+#include <algorithm>
+#include <math.h>
+
+#include "defines.h"
+
+//------------------------------------------------------------------------------/
+//   PACKED SYMMETRIC MATRIX CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Read-only storage for the pp x pp matrix of correlations between predictors. Since this matrix is symmetric,
+//   only the upper triangle (including the diagonal) is stored, i.e. pp*(pp+1)/2 values.
+//
+// Three memory layouts are supported:
+//
+//   1) PACKED: The column-major upper triangle, which is what R produces with cors[upper.tri(cors, diag = TRUE)];
+//               the element (a, b) with a <= b lives at a + b*(b+1)/2. This is the layout used by cor_vector.
+//   2) TILED: The upper triangle is cut into square tiles of _PSM_TILE_SIZE_ x _PSM_TILE_SIZE_ values, stored
+//              one after another (tiles in column-major order over the upper triangle, values in column-major
+//              order within each tile). Elements (a, b) and (a', b') with nearby indices then share a tile (and
+//              hence a few cache lines), which helps when the parents of a node are scattered across the columns.
+//              Diagonal tiles are stored in full, so this costs an extra O(pp * _PSM_TILE_SIZE_) values.
+//   3) PACKED_BY_ROW: The row-major upper triangle; row a holds (a, a), (a, a+1), ..., (a, pp-1) contiguously.
+//                      This is the order in which concaveCDInit visits the pairs (i, j > i), so a full sweep
+//                      walks the data front to back. It is the default layout for correlation files (see
+//                      CorrelationFile.h), where it keeps page faults sequential.
+//
+// All index arithmetic is done with std::size_t: The old inline expression a + b*(b+1)/2 with unsigned int
+//   overflows as soon as pp > ~92k.
+//
+// If the input is already in the requested layout and precision, the matrix can either own a copy of the data or
+//   simply point to an existing array (e.g. the NumericVector passed in from R, or a memory-mapped file) to avoid
+//   doubling the memory footprint. Otherwise the input must be PACKED and the matrix owns a rearranged copy.
+//
+// The values can be stored in either double or single precision (PackedSymmetricMatrix and
+//   PackedSymmetricMatrixFloat, respectively). Since the correlations are read-only once they have been computed,
+//   storing them as floats halves both the memory footprint and the memory traffic in the hot loops of the
+//   algorithm (e.g. singleUpdate and computeEdgeLoss). value() always returns a double, so all of the arithmetic
+//   downstream (and in particular the sigmas) stays in double precision; the only loss is the ~1e-7 relative
+//   rounding error of each stored correlation.
+//
+// The layout enum and the static index helpers live in the non-template base class PackedSymmetricLayout so that
+//   they are shared by both precisions.
+//
+class PackedSymmetricLayout{
+
+public:
+    enum Layout { PACKED = 0, TILED = 1, PACKED_BY_ROW = 2 };
+
+    //
+    // Helper functions for the PACKED layouts (also used when converting between layouts)
+    //
+    static std::size_t packedIndex(std::size_t a, std::size_t b);   // position of (a, b), a <= b, in the packed vector
+    static std::size_t rowPackedIndex(std::size_t a, std::size_t b, std::size_t pp);    // same for PACKED_BY_ROW
+    static std::size_t packedLength(std::size_t pp);                // pp*(pp+1)/2
+    static std::size_t packedDim(std::size_t len);                  // inverse of packedLength
+    static std::size_t tiledLength(std::size_t pp);                 // number of values stored in the TILED layout
+};
+
+template <typename T>
+class PackedSymmetricStorage : public PackedSymmetricLayout{
+
+public:
+    //
+    // Constructors
+    //
+    PackedSymmetricStorage(const std::vector<double>& cors_in,      // Explicit Constructor
+                           Layout layout_in = PACKED);              //  (Always copies the data)
+
+    template <typename U>                                           //
+    PackedSymmetricStorage(const U* cors_in,                        // Explicit Constructor
+                           std::size_t sizeOfMatrix,                //  (Does NOT copy the data if layout_in = input_layout
+                           Layout layout_in = PACKED,               //   and U = T)
+                           Layout input_layout = PACKED);           //
+
+    PackedSymmetricStorage(const PackedSymmetricStorage& other);                // Copy Constructor
+    PackedSymmetricStorage& operator=(const PackedSymmetricStorage& other);     // (data must be re-pointed at our own storage)
+
+    //
+    // Accessor functions
+    //
+    double value(std::size_t a, std::size_t b) const;   // get the (a, b) element; the order of a and b does not matter
+    std::size_t dim() const;                            // dimension (i.e. # of nodes)
+    std::size_t length() const;                         // number of distinct values in the matrix, pp*(pp+1)/2
+    Layout layout() const;                              // which memory layout is in use
+
+private:
+    std::size_t pp;                 // dimension of the matrix
+    Layout lay;                     // memory layout of the data
+    std::size_t numTiles;           // number of tiles per row / column (TILED only)
+
+    std::vector<T> storage;         // owned copy of the data (empty if we are pointing to external data)
+    const T* data;                  // pointer to the first element of the data (either storage or external)
+
+    std::size_t tiledIndex(std::size_t a, std::size_t b) const;    // position of (a, b), a <= b, in the TILED layout
+    std::size_t rowIndex(std::size_t a, std::size_t b) const;      // position of (a, b), a <= b, in the PACKED_BY_ROW layout
+    std::size_t index(std::size_t a, std::size_t b) const;         // position of (a, b), a <= b, in the current layout
+    template <typename U> void init(const U* cors_in, Layout input_layout, bool copy);
+
+    // Used to decide at compile time whether or not we can point directly at the input
+    static bool samePrecision(const T*){ return true; }
+    template <typename U> static bool samePrecision(const U*){ return false; }
+};
+
+typedef PackedSymmetricStorage<double> PackedSymmetricMatrix;
+typedef PackedSymmetricStorage<float> PackedSymmetricMatrixFloat;
+
+//
+// Initialization method
+//   Sets up the data pointer; copies / rearranges / converts the input if requested (or if required by the layout
+//   or precision)
+//
+template <typename T>
+template <typename U>
+void PackedSymmetricStorage<T>::init(const U* cors_in, Layout input_layout, bool copy){
+    numTiles = (pp + _PSM_TILE_SIZE_ - 1) / _PSM_TILE_SIZE_;
+
+    if(lay == input_layout){
+        if(copy || !samePrecision(cors_in)){
+            std::size_t len = (lay == TILED) ? tiledLength(pp) : packedLength(pp);
+            storage.assign(cors_in, cors_in + len);
+            data = storage.empty() ? NULL : &storage[0];
+        } else{
+            data = reinterpret_cast<const T*>(cors_in);
+        }
+    } else{
+        if(input_layout != PACKED){
+            ERROR_OUTPUT << "Unsupported conversion between layouts: Input to PackedSymmetricMatrix must be PACKED." << std::endl;
+        }
+
+        storage.assign((lay == TILED) ? tiledLength(pp) : packedLength(pp), 0);
+
+        for(std::size_t b = 0; b < pp; ++b){
+            for(std::size_t a = 0; a <= b; ++a){
+                storage[index(a, b)] = static_cast<T>(cors_in[packedIndex(a, b)]);
+            }
+        }
+
+        data = storage.empty() ? NULL : &storage[0];
+    }
+}
+
+// Explicit constructor
+//   Takes in an STL vector in the PACKED layout and copies it into the requested layout
+//
+template <typename T>
+PackedSymmetricStorage<T>::PackedSymmetricStorage(const std::vector<double>& cors_in, Layout layout_in){
+    pp = packedDim(cors_in.size());
+    lay = layout_in;
+
+    if(packedLength(pp) != cors_in.size()){
+        ERROR_OUTPUT << "Dimension mismatch in cors input: Length of cors must be equal to pp*(pp+1)/2 for some pp." << std::endl;
+    }
+
+    init(cors_in.empty() ? NULL : &cors_in[0], PACKED, true);
+}
+
+// Explicit constructor
+//   Takes in a pointer to an array in input_layout for a matrix of dimension sizeOfMatrix; the array must outlive
+//   this object when layout_in = input_layout and U = T since no copy is made
+//
+template <typename T>
+template <typename U>
+PackedSymmetricStorage<T>::PackedSymmetricStorage(const U* cors_in, std::size_t sizeOfMatrix, Layout layout_in, Layout input_layout){
+    pp = sizeOfMatrix;
+    lay = layout_in;
+
+    init(cors_in, input_layout, false);
+}
+
+// Copy constructor
+//   The default copy would leave data pointing at the storage of the original object
+//
+template <typename T>
+PackedSymmetricStorage<T>::PackedSymmetricStorage(const PackedSymmetricStorage& other){
+    *this = other;
+}
+
+template <typename T>
+PackedSymmetricStorage<T>& PackedSymmetricStorage<T>::operator=(const PackedSymmetricStorage& other){
+    pp = other.pp;
+    lay = other.lay;
+    numTiles = other.numTiles;
+    storage = other.storage;
+    data = storage.empty() ? other.data : &storage[0];
+
+    return *this;
+}
+
+inline std::size_t PackedSymmetricLayout::packedIndex(std::size_t a, std::size_t b){
+    return a + b * (b + 1) / 2;
+}
+
+std::size_t PackedSymmetricLayout::packedLength(std::size_t pp){
+    return pp * (pp + 1) / 2;
+}
+
+// Solve len = pp*(pp+1)/2 for pp; the correction steps guard against rounding error in sqrt for huge pp
+std::size_t PackedSymmetricLayout::packedDim(std::size_t len){
+    std::size_t p = static_cast<std::size_t>((sqrt(8.0 * static_cast<double>(len) + 1.0) - 1.0) / 2.0);
+    while(packedLength(p) > len) --p;
+    while(packedLength(p + 1) <= len) ++p;
+
+    return p;
+}
+
+std::size_t PackedSymmetricLayout::tiledLength(std::size_t pp){
+    std::size_t numTiles = (pp + _PSM_TILE_SIZE_ - 1) / _PSM_TILE_SIZE_;
+
+    return numTiles * (numTiles + 1) / 2 * _PSM_TILE_SIZE_ * _PSM_TILE_SIZE_;
+}
+
+// Row a starts after the rows 0, ..., a-1 of lengths pp, pp-1, ..., pp-a+1, and (a, a) is its first element
+inline std::size_t PackedSymmetricLayout::rowPackedIndex(std::size_t a, std::size_t b, std::size_t pp){
+    return a * (2 * pp - a - 1) / 2 + b;
+}
+
+template <typename T>
+inline std::size_t PackedSymmetricStorage<T>::tiledIndex(std::size_t a, std::size_t b) const{
+    const std::size_t TS = _PSM_TILE_SIZE_;
+    std::size_t I = a / TS, J = b / TS;
+
+    return (J * (J + 1) / 2 + I) * TS * TS + (a % TS) + (b % TS) * TS;
+}
+
+template <typename T>
+inline std::size_t PackedSymmetricStorage<T>::rowIndex(std::size_t a, std::size_t b) const{
+    return rowPackedIndex(a, b, pp);
+}
+
+template <typename T>
+inline std::size_t PackedSymmetricStorage<T>::index(std::size_t a, std::size_t b) const{
+    switch(lay){
+        case TILED: return tiledIndex(a, b);
+        case PACKED_BY_ROW: return rowIndex(a, b);
+        default: return packedIndex(a, b);
+    }
+}
+
+// Returns the (a, b) element; since the matrix is symmetric, (a, b) and (b, a) are the same element
+template <typename T>
+inline double PackedSymmetricStorage<T>::value(std::size_t a, std::size_t b) const{
+    if(a > b) std::swap(a, b);
+
+    return static_cast<double>(data[index(a, b)]);
+}
+
+template <typename T>
+std::size_t PackedSymmetricStorage<T>::dim() const{
+    return pp;
+}
+
+template <typename T>
+std::size_t PackedSymmetricStorage<T>::length() const{
+    return packedLength(pp);
+}
+
+template <typename T>
+PackedSymmetricLayout::Layout PackedSymmetricStorage<T>::layout() const{
+    return lay;
+}
+
+#endif
@@ -0,0 +1,172 @@
+//
+//  PairScreen.h
+//  ccdr_proj
+//
+
+#ifndef PairScreen_h
+#define PairScreen_h
+
+#include <vector>
+#include <algorithm>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+
+//------------------------------------------------------------------------------/
+//   PAIR SCREEN CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Keeps track of the pairs of nodes that concaveCDInit visits when the CCDr algorithm is run over a grid of
+//   lambdas (see gridCCDr). Without screening, every sweep of concaveCDInit computes two single parameter updates
+//   for each of the pp*(pp-1)/2 pairs, although at large values of lambda almost all of these are zero.
+//
+// The pairs are screened with the sequential strong rule (Tibshirani et al., 2012): A pair (i, j) is discarded at
+//   lambda_k if both residual factors (see singleResidual) at the estimate for the previous value lambda_{k-1}
+//   satisfy
+//
+//          |res_ij| < 2 * lambda_k - lambda_{k-1}.
+//
+// The strong rule is a heuristic, so it is followed by a check of the KKT conditions: Once the algorithm has
+//   converged on the screened pairs, the residual factors of ALL pairs are computed (see screenPairs). Any
+//   discarded pair whose single parameter update would be nonzero (i.e. |res| > lambda_k) is a violation; the
+//   violators are added to the candidates and the algorithm is run again. The estimate is therefore a fixed
+//   point of a complete sweep over all pairs, just as without screening. The same pass over all pairs also
+//   applies the strong rule for the next value of lambda, so each value of lambda only pays for one pass over all
+//   pairs instead of one per sweep.
+//
+// Pairs with a block in betas are always visited, whether or not they are candidates. Zeroed-out blocks count as
+//   pairs without a block, so that the visited pairs do not depend on whether betas has been compacted (see
+//   SparseBlockMatrix::compact). The screen is inactive (i.e. all pairs are visited) for the first value of lambda
+//   and whenever 2 * lambda_k - lambda_{k-1} <= 0.
+//
+class PairScreen{
+
+public:
+    //
+    // Constructors
+    //
+    PairScreen(int pp);
+
+    //
+    // Member functions
+    //
+    bool active() const;                                    // false if all pairs are visited
+    double nextLambda() const;                              // next value of lambda in the grid (or < 0 if none)
+    void setNextLambda(double lambda);
+    const std::vector<int>& pairs(int i,                    // returns the nodes j > i to be visited along with i:
+                                  const SparseBlockMatrix& betas);  //  the candidates and the blocks in betas
+    bool isCandidate(int i, int j) const;                   // true if the pair (i, j > i) is a candidate
+
+    void addCandidate(int i, int j);                        // admit the pair (i, j > i) for the current lambda
+    void keepNext(int i, int j);                            // admit the pair (i, j > i) for the next lambda
+    void clearNext();                                       // start a new list of candidates for the next lambda
+    void advance(bool screened);                            // move on to the next lambda; screened = false turns the screen off
+
+    std::size_t candidates() const;                         // number of candidate pairs
+    std::size_t violations() const;                         // number of violations found by the KKT checks so far
+
+private:
+    bool isActive;
+    double next;
+    std::vector< std::vector<int> > current;    // current[i] = candidates j > i (sorted) for the current lambda
+    std::vector< std::vector<int> > upcoming;   // upcoming[i] = candidates j > i (sorted) for the next lambda
+    std::vector<int> scratch;
+    std::size_t nCandidates, nViolations;
+};
+
+PairScreen::PairScreen(int pp){
+    isActive = false;
+    next = -1;
+    current.resize(pp);
+    upcoming.resize(pp);
+    nCandidates = 0;
+    nViolations = 0;
+}
+
+bool PairScreen::active() const{
+    return isActive;
+}
+
+double PairScreen::nextLambda() const{
+    return next;
+}
+
+void PairScreen::setNextLambda(double lambda){
+    next = lambda;
+}
+
+//
+// pairs
+//
+//   Merges the candidates in row i with the neighbours of i in betas (both lists only hold nodes j > i), so that
+//   the pairs are visited in the same order as the full sweep.
+//
+const std::vector<int>& PairScreen::pairs(int i, const SparseBlockMatrix& betas){
+    scratch.assign(current[i].begin(), current[i].end());
+    for(int k = 0; k < betas.rowsizes(i); ++k){
+        if(betas.row(i, k) <= i || (betas.value(i, k) == 0 && betas.getSiblingValue(i, k) == 0)) continue;
+
+        scratch.push_back(betas.row(i, k));
+    }
+
+    std::sort(scratch.begin(), scratch.end());
+    scratch.erase(std::unique(scratch.begin(), scratch.end()), scratch.end());
+
+    return scratch;
+}
+
+bool PairScreen::isCandidate(int i, int j) const{
+    return std::binary_search(current[i].begin(), current[i].end(), j);
+}
+
+// Violations are found row by row, so appending keeps each row sorted unless the row is revisited
+void PairScreen::addCandidate(int i, int j){
+    if(!current[i].empty() && current[i].back() > j){
+        current[i].insert(std::lower_bound(current[i].begin(), current[i].end(), j), j);
+    } else{
+        current[i].push_back(j);
+    }
+
+    ++nCandidates;
+    ++nViolations;
+}
+
+// Only called in order of (i, j) by screenPairs
+void PairScreen::keepNext(int i, int j){
+    upcoming[i].push_back(j);
+}
+
+void PairScreen::clearNext(){
+    for(std::size_t i = 0; i < upcoming.size(); ++i){
+        upcoming[i].clear();
+    }
+}
+
+void PairScreen::advance(bool screened){
+    current.swap(upcoming);
+    clearNext();
+
+    nCandidates = 0;
+    if(screened){
+        for(std::size_t i = 0; i < current.size(); ++i){
+            nCandidates += current[i].size();
+        }
+    } else{
+        for(std::size_t i = 0; i < current.size(); ++i){
+            current[i].clear();
+        }
+    }
+
+    isActive = screened;
+}
+
+std::size_t PairScreen::candidates() const{
+    return nCandidates;
+}
+
+std::size_t PairScreen::violations() const{
+    return nViolations;
+}
+
+#endif
@@ -6,8 +6,8 @@
 using namespace Rcpp;
 
 // gridCCDr
-List gridCCDr(NumericVector cors, List init_betas, unsigned int nn, NumericVector lambdas, NumericVector params, int verbose);
-RcppExport SEXP ccdr_gridCCDr(SEXP corsSEXP, SEXP init_betasSEXP, SEXP nnSEXP, SEXP lambdasSEXP, SEXP paramsSEXP, SEXP verboseSEXP) {
+List gridCCDr(NumericVector cors, List init_betas, unsigned int nn, NumericVector lambdas, NumericVector params, int verbose, int layout, bool single, bool screen);
+RcppExport SEXP ccdr_gridCCDr(SEXP corsSEXP, SEXP init_betasSEXP, SEXP nnSEXP, SEXP lambdasSEXP, SEXP paramsSEXP, SEXP verboseSEXP, SEXP layoutSEXP, SEXP singleSEXP, SEXP screenSEXP) {
 BEGIN_RCPP
     Rcpp::RObject __result;
     Rcpp::RNGScope __rngScope;
@@ -17,13 +17,16 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< NumericVector >::type lambdas(lambdasSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type params(paramsSEXP);
     Rcpp::traits::input_parameter< int >::type verbose(verboseSEXP);
-    __result = Rcpp::wrap(gridCCDr(cors, init_betas, nn, lambdas, params, verbose));
+    Rcpp::traits::input_parameter< int >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    Rcpp::traits::input_parameter< bool >::type screen(screenSEXP);
+    __result = Rcpp::wrap(gridCCDr(cors, init_betas, nn, lambdas, params, verbose, layout, single, screen));
     return __result;
 END_RCPP
 }
 // singleCCDr
-List singleCCDr(NumericVector cors, List init_betas, unsigned int nn, double lambda, NumericVector params, int verbose);
-RcppExport SEXP ccdr_singleCCDr(SEXP corsSEXP, SEXP init_betasSEXP, SEXP nnSEXP, SEXP lambdaSEXP, SEXP paramsSEXP, SEXP verboseSEXP) {
+List singleCCDr(NumericVector cors, List init_betas, unsigned int nn, double lambda, NumericVector params, int verbose, int layout, bool single);
+RcppExport SEXP ccdr_singleCCDr(SEXP corsSEXP, SEXP init_betasSEXP, SEXP nnSEXP, SEXP lambdaSEXP, SEXP paramsSEXP, SEXP verboseSEXP, SEXP layoutSEXP, SEXP singleSEXP) {
 BEGIN_RCPP
     Rcpp::RObject __result;
     Rcpp::RNGScope __rngScope;
@@ -33,7 +36,138 @@ BEGIN_RCPP
     Rcpp::traits::input_parameter< double >::type lambda(lambdaSEXP);
     Rcpp::traits::input_parameter< NumericVector >::type params(paramsSEXP);
     Rcpp::traits::input_parameter< int >::type verbose(verboseSEXP);
-    __result = Rcpp::wrap(singleCCDr(cors, init_betas, nn, lambda, params, verbose));
+    Rcpp::traits::input_parameter< int >::type layout(layoutSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    __result = Rcpp::wrap(singleCCDr(cors, init_betas, nn, lambda, params, verbose, layout, single));
+    return __result;
+END_RCPP
+}
+// packedCorrelations
+NumericVector packedCorrelations(NumericMatrix X, int nthreads);
+RcppExport SEXP ccdr_packedCorrelations(SEXP XSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    __result = Rcpp::wrap(packedCorrelations(X, nthreads));
+    return __result;
+END_RCPP
+}
+// sparsePackedCorrelations
+NumericVector sparsePackedCorrelations(IntegerVector colPtr, IntegerVector rowIdx, NumericVector vals, int nn, int nthreads);
+RcppExport SEXP ccdr_sparsePackedCorrelations(SEXP colPtrSEXP, SEXP rowIdxSEXP, SEXP valsSEXP, SEXP nnSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< IntegerVector >::type colPtr(colPtrSEXP);
+    Rcpp::traits::input_parameter< IntegerVector >::type rowIdx(rowIdxSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type vals(valsSEXP);
+    Rcpp::traits::input_parameter< int >::type nn(nnSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    __result = Rcpp::wrap(sparsePackedCorrelations(colPtr, rowIdx, vals, nn, nthreads));
+    return __result;
+END_RCPP
+}
+// updateSufficientStats
+List updateSufficientStats(NumericMatrix X, NumericVector means, NumericVector comoments, int nn, int nthreads);
+RcppExport SEXP ccdr_updateSufficientStats(SEXP XSEXP, SEXP meansSEXP, SEXP comomentsSEXP, SEXP nnSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type means(meansSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type comoments(comomentsSEXP);
+    Rcpp::traits::input_parameter< int >::type nn(nnSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    __result = Rcpp::wrap(updateSufficientStats(X, means, comoments, nn, nthreads));
+    return __result;
+END_RCPP
+}
+// sufficientStatsCorrelations
+NumericVector sufficientStatsCorrelations(NumericVector comoments, int pp);
+RcppExport SEXP ccdr_sufficientStatsCorrelations(SEXP comomentsSEXP, SEXP ppSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< NumericVector >::type comoments(comomentsSEXP);
+    Rcpp::traits::input_parameter< int >::type pp(ppSEXP);
+    __result = Rcpp::wrap(sufficientStatsCorrelations(comoments, pp));
+    return __result;
+END_RCPP
+}
+// streamSufficientStats
+List streamSufficientStats(std::string path, std::string format, bool header, std::string sep, int nrow, int ncol, int nthreads);
+RcppExport SEXP ccdr_streamSufficientStats(SEXP pathSEXP, SEXP formatSEXP, SEXP headerSEXP, SEXP sepSEXP, SEXP nrowSEXP, SEXP ncolSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< std::string >::type format(formatSEXP);
+    Rcpp::traits::input_parameter< bool >::type header(headerSEXP);
+    Rcpp::traits::input_parameter< std::string >::type sep(sepSEXP);
+    Rcpp::traits::input_parameter< int >::type nrow(nrowSEXP);
+    Rcpp::traits::input_parameter< int >::type ncol(ncolSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    __result = Rcpp::wrap(streamSufficientStats(path, format, header, sep, nrow, ncol, nthreads));
+    return __result;
+END_RCPP
+}
+// writeCorrelationFile
+bool writeCorrelationFile(NumericMatrix X, std::string path, bool single, int nthreads);
+RcppExport SEXP ccdr_writeCorrelationFile(SEXP XSEXP, SEXP pathSEXP, SEXP singleSEXP, SEXP nthreadsSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< bool >::type single(singleSEXP);
+    Rcpp::traits::input_parameter< int >::type nthreads(nthreadsSEXP);
+    __result = Rcpp::wrap(writeCorrelationFile(X, path, single, nthreads));
+    return __result;
+END_RCPP
+}
+// correlationFileInfo
+List correlationFileInfo(std::string path);
+RcppExport SEXP ccdr_correlationFileInfo(SEXP pathSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    __result = Rcpp::wrap(correlationFileInfo(path));
+    return __result;
+END_RCPP
+}
+// gridCCDrFile
+List gridCCDrFile(std::string path, List init_betas, NumericVector lambdas, NumericVector params, int verbose, bool screen);
+RcppExport SEXP ccdr_gridCCDrFile(SEXP pathSEXP, SEXP init_betasSEXP, SEXP lambdasSEXP, SEXP paramsSEXP, SEXP verboseSEXP, SEXP screenSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< std::string >::type path(pathSEXP);
+    Rcpp::traits::input_parameter< List >::type init_betas(init_betasSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type lambdas(lambdasSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type params(paramsSEXP);
+    Rcpp::traits::input_parameter< int >::type verbose(verboseSEXP);
+    Rcpp::traits::input_parameter< bool >::type screen(screenSEXP);
+    __result = Rcpp::wrap(gridCCDrFile(path, init_betas, lambdas, params, verbose, screen));
+    return __result;
+END_RCPP
+}
+// gridCCDrLazy
+List gridCCDrLazy(NumericMatrix X, List init_betas, NumericVector lambdas, NumericVector params, int cacheTiles, int verbose, bool screen);
+RcppExport SEXP ccdr_gridCCDrLazy(SEXP XSEXP, SEXP init_betasSEXP, SEXP lambdasSEXP, SEXP paramsSEXP, SEXP cacheTilesSEXP, SEXP verboseSEXP, SEXP screenSEXP) {
+BEGIN_RCPP
+    Rcpp::RObject __result;
+    Rcpp::RNGScope __rngScope;
+    Rcpp::traits::input_parameter< NumericMatrix >::type X(XSEXP);
+    Rcpp::traits::input_parameter< List >::type init_betas(init_betasSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type lambdas(lambdasSEXP);
+    Rcpp::traits::input_parameter< NumericVector >::type params(paramsSEXP);
+    Rcpp::traits::input_parameter< int >::type cacheTiles(cacheTilesSEXP);
+    Rcpp::traits::input_parameter< int >::type verbose(verboseSEXP);
+    Rcpp::traits::input_parameter< bool >::type screen(screenSEXP);
+    __result = Rcpp::wrap(gridCCDrLazy(X, init_betas, lambdas, params, cacheTiles, verbose, screen));
     return __result;
 END_RCPP
 }
@@ -0,0 +1,171 @@
+//
+//  SigmaUpdater.h
+//  ccdr_proj
+//
+
+#ifndef SigmaUpdater_h
+#define SigmaUpdater_h
+
+#include <vector>
+#include <math.h>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+#include "KKTCache.h"
+#include "CCDrAlgorithm.h"
+
+//------------------------------------------------------------------------------/
+//   SIGMA UPDATER CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Recomputes the sigmas at the start of every call to concaveCDInit and concaveCD (see Section 4.2.2. of the
+//   computational paper):
+//
+//          c_j = \sum_{i in rows(j)} beta_ij * <xj,xi>,        sigma_j = (c_j + sqrt(c_j^2 + 4n)) / 2
+//
+// sigma_j only depends on column j of betas, and usually only a handful of columns change between two calls, so the
+//   columns are tracked in the same way as in EdgeLossCache: whenever column j changes (a value in the column, or a
+//   new block in the column), it is marked as stale (see columnChanged), and update only recomputes the sigmas of
+//   the stale columns. Skipping a clean column is exact, since recomputing its sigma would give the same value.
+//
+// The stale columns are split between the threads when there are at least _PARALLEL_SIGMA_MIN_COLUMNS_ of them (each
+//   column only writes sigma_j and the drift of column j in the KKT cache). Within a column, the nonzero values and
+//   their correlations <xj,xi> are gathered into buffers of _SIGMA_CHUNK_ values at a time, and c_j is accumulated
+//   from the buffers in four independent partial sums, so that the multiply-adds can be vectorized. The order of the
+//   summation is fixed, so the sigmas do not depend on the number of threads, nor on the zeroed-out blocks that
+//   compaction removes from the column (see SparseBlockMatrix::compact).
+//
+// The time spent in update is accumulated in seconds (see CCDrCounters::now).
+//
+// NOTE: The threads call cors.value() concurrently, so CorMatrix must be safe to read concurrently whenever
+//        nthreads != 1 (see concaveCDInit).
+//
+class SigmaUpdater{
+
+public:
+    //
+    // Constructors
+    //
+    SigmaUpdater(int pp);
+
+    //
+    // Member functions
+    //
+    template <typename CorMatrix>
+    void update(const unsigned int nn,                  // recompute the sigmas of the stale columns of betas
+                SparseBlockMatrix& betas,
+                KKTCache* kkt,
+                const CorMatrix& cors,
+                int nthreads);
+    void columnChanged(int j);                          // mark sigma_j as stale
+
+    std::size_t updates() const;                        // number of sigmas recomputed so far
+    std::size_t skipped() const;                        // number of clean sigmas skipped so far
+    double seconds() const;                             // time spent in update so far
+
+private:
+    std::vector<char> stale;
+    std::vector<int> columns;                           // stale columns in the current call to update
+    std::size_t nUpdates, nSkipped;
+    double elapsed;
+
+    template <typename CorMatrix>
+    static double columnSum(int j, const SparseBlockMatrix& betas, const CorMatrix& cors);
+};
+
+SigmaUpdater::SigmaUpdater(int pp){
+    stale.assign(pp, 1);
+    nUpdates = 0;
+    nSkipped = 0;
+    elapsed = 0;
+}
+
+// c_j = \sum_{i in rows(j)} beta_ij * <xj,xi>
+template <typename CorMatrix>
+inline double SigmaUpdater::columnSum(int j, const SparseBlockMatrix& betas, const CorMatrix& cors){
+    const int* rows = betas.rowData(j);
+    const double* vals = betas.valueData(j);
+    int size = betas.rowsizes(j);
+
+    double gathered[_SIGMA_CHUNK_], values[_SIGMA_CHUNK_];
+    double c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    int start = 0;
+    while(start < size){
+        // Only the nonzero values are gathered, so the partial sums do not depend on the zeroes in the column
+        int len = 0;
+        for(; start < size && len < _SIGMA_CHUNK_; ++start){
+            if(vals[start] == 0) continue;
+
+            values[len] = vals[start];
+            gathered[len] = cors.value(j, rows[start]);
+            ++len;
+        }
+
+        int l = 0;
+        for(; l + 4 <= len; l += 4){
+            c0 += values[l] * gathered[l];
+            c1 += values[l + 1] * gathered[l + 1];
+            c2 += values[l + 2] * gathered[l + 2];
+            c3 += values[l + 3] * gathered[l + 3];
+        }
+        for(; l < len; ++l){
+            c0 += values[l] * gathered[l];
+        }
+    }
+
+    return (c0 + c1) + (c2 + c3);
+}
+
+template <typename CorMatrix>
+void SigmaUpdater::update(const unsigned int nn, SparseBlockMatrix& betas, KKTCache* kkt, const CorMatrix& cors, int nthreads){
+    double start = CCDrCounters::now();
+
+    columns.clear();
+    for(int j = 0; j < betas.dim(); ++j){
+        if(stale[j]) columns.push_back(j);
+    }
+
+    #ifdef _OPENMP
+        if(nthreads <= 0) nthreads = omp_get_max_threads();
+    #else
+        nthreads = 1;
+    #endif
+
+    long ncols = static_cast<long>(columns.size());
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 16) num_threads(nthreads) if(nthreads > 1 && ncols >= _PARALLEL_SIGMA_MIN_COLUMNS_)
+    #endif
+    for(long n = 0; n < ncols; ++n){
+        int j = columns[n];
+        double c = columnSum(j, betas, cors);
+
+        double s = 0.5 * (1.0 * c + sqrt(c * c + 4 * nn));
+        if(kkt != NULL) kkt->columnChanged(j, s - betas.sigma(j));
+        betas.setSigma(j, s);
+        stale[j] = 0;
+    }
+
+    nUpdates += columns.size();
+    nSkipped += betas.dim() - columns.size();
+    elapsed += CCDrCounters::now() - start;
+}
+
+inline void SigmaUpdater::columnChanged(int j){
+    stale[j] = 1;
+}
+
+std::size_t SigmaUpdater::updates() const{
+    return nUpdates;
+}
+
+std::size_t SigmaUpdater::skipped() const{
+    return nSkipped;
+}
+
+double SigmaUpdater::seconds() const{
+    return elapsed;
+}
+
+#endif
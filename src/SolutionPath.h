@@ -0,0 +1,276 @@
+//
+//  SolutionPath.h
+//  ccdr_proj
+//
+
+#ifndef SolutionPath_h
+#define SolutionPath_h
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include "defines.h"
+#include "SparseBlockMatrix.h"
+
+//------------------------------------------------------------------------------/
+//   SOLUTION PATH CLASS
+//------------------------------------------------------------------------------/
+
+//
+// Stores the estimates computed by gridCCDr for a grid of lambdas. Keeping a full copy of betas for every lambda
+//   costs O(nlam * (pp + edges)) memory, although consecutive estimates usually differ in only a few blocks. Instead,
+//   each estimate is stored as the list of changes from the previous one (the first estimate is stored as the list
+//   of changes from the empty matrix, i.e. in full):
+//
+//     1) Blocks: Every block {beta_ij, beta_ji} (i < j) whose values differ from the previous estimate, with its new
+//                 values (zero values = the block has been removed).
+//     2) Sigmas: Every sigma_j that differs from the previous estimate, with its new value.
+//
+//   The blocks vector is not needed to describe an estimate, so none of the indices of SparseBlockMatrix are stored.
+//   To compute the next diff, the (nonzero) blocks and the sigmas of the last estimate are kept, sorted by block.
+//
+// The estimates are read back either in order, by applying one diff at a time to a single SparseBlockMatrix (see
+//   Cursor), or one at a time by replaying the path up to the requested lambda (see get). There are no full
+//   copies to start from, so get(l) costs as much as reading the first l + 1 estimates with a Cursor; reading
+//   several estimates with get is quadratic in the length of the path, so use a Cursor instead.
+//
+class SolutionPath{
+
+public:
+    //
+    // Constructors
+    //
+    SolutionPath(int pp);
+
+    //
+    // Member functions
+    //
+    void push_back(const SparseBlockMatrix& betas, double lambda);  // add the estimate for the next lambda
+    std::size_t size() const;                                       // number of estimates in the path
+    int dim() const;                                                // dimension (i.e. # of nodes) of the estimates
+    double lambda(std::size_t l) const;                             // value of lambda for the lth estimate
+    std::size_t changes(std::size_t l) const;                       // number of blocks that changed at the lth estimate
+    std::size_t bytes() const;                                      // memory used by the stored diffs
+    SparseBlockMatrix get(std::size_t l) const;                     // reconstruct the lth estimate (see above for the cost)
+    void swap(SolutionPath& other);                                 // exchange the contents of two paths in O(1)
+
+    //
+    // Reads the path in order: each call to next applies the diff of the next estimate to betas
+    //
+    class Cursor{
+
+    public:
+        Cursor(const SolutionPath& path);
+
+        bool next();                                // move to the next estimate (false at the end of the path)
+        std::size_t index() const;                  // index of the current estimate
+        double lambda() const;                      // value of lambda for the current estimate
+        const SparseBlockMatrix& betas() const;     // the current estimate
+
+    private:
+        friend class SolutionPath;
+
+        const SolutionPath* path;
+        std::size_t pos;                            // index of the current estimate + 1 (0 = before the first one)
+        SparseBlockMatrix current;
+    };
+
+private:
+    int pp;
+    std::vector<double> lambdas;
+
+    // The diff of the lth estimate is [blockOffsets[l], blockOffsets[l + 1]) and [sigmaOffsets[l], sigmaOffsets[l + 1])
+    std::vector<std::size_t> blockOffsets;
+    std::vector<uint64_t> blockKeys;            // j * pp + i for the block (i, j), i < j
+    std::vector<double> blockVals;              // beta_ij, beta_ji for each changed block
+    std::vector<std::size_t> sigmaOffsets;
+    std::vector<int> sigmaIndices;
+    std::vector<double> sigmaVals;
+
+    // The last estimate (to compute the next diff)
+    std::vector<uint64_t> lastKeys;
+    std::vector<double> lastVals;
+    std::vector<double> lastSigmas;
+
+    void addChange(uint64_t key, double valij, double valji);
+};
+
+SolutionPath::SolutionPath(int pp_){
+    pp = pp_;
+    blockOffsets.assign(1, 0);
+    sigmaOffsets.assign(1, 0);
+    lastSigmas.assign(pp, 0);
+}
+
+inline void SolutionPath::addChange(uint64_t key, double valij, double valji){
+    blockKeys.push_back(key);
+    blockVals.push_back(valij);
+    blockVals.push_back(valji);
+}
+
+void SolutionPath::push_back(const SparseBlockMatrix& betas, double lambda){
+    //
+    // Nonzero blocks of betas, sorted by key
+    //
+    std::vector< std::pair<uint64_t, std::size_t> > order;
+    std::vector<double> vals;
+    for(int j = 0; j < pp; ++j){
+        for(int k = 0; k < betas.rowsizes(j); ++k){
+            int i = betas.row(j, k);
+            if(j <= i) continue;
+
+            double valij = betas.value(j, k), valji = betas.getSiblingValue(j, k);
+            if(valij == 0 && valji == 0) continue;
+
+            order.push_back(std::make_pair(static_cast<uint64_t>(j) * pp + i, vals.size()));
+            vals.push_back(valij);
+            vals.push_back(valji);
+        }
+    }
+    std::sort(order.begin(), order.end());
+
+    std::vector<uint64_t> keys(order.size());
+    std::vector<double> sorted(2 * order.size());
+    for(std::size_t n = 0; n < order.size(); ++n){
+        keys[n] = order[n].first;
+        sorted[2 * n] = vals[order[n].second];
+        sorted[2 * n + 1] = vals[order[n].second + 1];
+    }
+
+    //
+    // Merge with the last estimate: new or changed blocks get their new values, removed blocks get zeroes
+    //
+    std::size_t a = 0, b = 0;
+    while(a < lastKeys.size() || b < keys.size()){
+        if(b == keys.size() || (a < lastKeys.size() && lastKeys[a] < keys[b])){
+            addChange(lastKeys[a], 0, 0);
+            ++a;
+        } else if(a == lastKeys.size() || keys[b] < lastKeys[a]){
+            addChange(keys[b], sorted[2 * b], sorted[2 * b + 1]);
+            ++b;
+        } else{
+            if(lastVals[2 * a] != sorted[2 * b] || lastVals[2 * a + 1] != sorted[2 * b + 1]){
+                addChange(keys[b], sorted[2 * b], sorted[2 * b + 1]);
+            }
+            ++a;
+            ++b;
+        }
+    }
+    blockOffsets.push_back(blockKeys.size());
+
+    for(int j = 0; j < pp; ++j){
+        if(betas.sigma(j) == lastSigmas[j]) continue;
+
+        sigmaIndices.push_back(j);
+        sigmaVals.push_back(betas.sigma(j));
+        lastSigmas[j] = betas.sigma(j);
+    }
+    sigmaOffsets.push_back(sigmaIndices.size());
+
+    lastKeys.swap(keys);
+    lastVals.swap(sorted);
+    lambdas.push_back(lambda);
+}
+
+std::size_t SolutionPath::size() const{
+    return lambdas.size();
+}
+
+int SolutionPath::dim() const{
+    return pp;
+}
+
+double SolutionPath::lambda(std::size_t l) const{
+    return lambdas[l];
+}
+
+std::size_t SolutionPath::changes(std::size_t l) const{
+    return blockOffsets[l + 1] - blockOffsets[l];
+}
+
+std::size_t SolutionPath::bytes() const{
+    return blockKeys.size() * sizeof(uint64_t) + blockVals.size() * sizeof(double)
+         + sigmaIndices.size() * sizeof(int) + sigmaVals.size() * sizeof(double)
+         + (blockOffsets.size() + sigmaOffsets.size()) * sizeof(std::size_t) + lambdas.size() * sizeof(double);
+}
+
+// Replays the path up to the lth estimate; the result has no zeroed-out blocks
+//  If l is past the end of the path, prints an error and returns the empty matrix
+SparseBlockMatrix SolutionPath::get(std::size_t l) const{
+    if(l >= size()){
+        ERROR_OUTPUT << "SolutionPath::get: Requested estimate " << l << " of a path with " << size() << " estimates." << std::endl;
+        return SparseBlockMatrix(pp);
+    }
+
+    Cursor it(*this);
+    while(it.next() && it.index() < l);
+
+    // The cursor is about to go away, so its estimate is taken over instead of copied
+    SparseBlockMatrix betas(0);
+    betas.swap(it.current);
+    betas.compact(0);
+
+    return betas;
+}
+
+void SolutionPath::swap(SolutionPath& other){
+    std::swap(pp, other.pp);
+    lambdas.swap(other.lambdas);
+    blockOffsets.swap(other.blockOffsets);
+    blockKeys.swap(other.blockKeys);
+    blockVals.swap(other.blockVals);
+    sigmaOffsets.swap(other.sigmaOffsets);
+    sigmaIndices.swap(other.sigmaIndices);
+    sigmaVals.swap(other.sigmaVals);
+    lastKeys.swap(other.lastKeys);
+    lastVals.swap(other.lastVals);
+    lastSigmas.swap(other.lastSigmas);
+}
+
+SolutionPath::Cursor::Cursor(const SolutionPath& path_) : current(path_.dim()){
+    path = &path_;
+    pos = 0;
+}
+
+bool SolutionPath::Cursor::next(){
+    if(pos >= path->size()) return false;
+
+    for(std::size_t n = path->blockOffsets[pos]; n < path->blockOffsets[pos + 1]; ++n){
+        int i = static_cast<int>(path->blockKeys[n] % path->pp);
+        int j = static_cast<int>(path->blockKeys[n] / path->pp);
+        double valij = path->blockVals[2 * n], valji = path->blockVals[2 * n + 1];
+
+        int k = current.find(i, j);
+        if(k >= 0){
+            current.updateBlock(j, k, valij, valji);
+        } else{
+            current.addBlock(i, j, valij, valji);
+        }
+    }
+
+    for(std::size_t n = path->sigmaOffsets[pos]; n < path->sigmaOffsets[pos + 1]; ++n){
+        current.setSigma(path->sigmaIndices[n], path->sigmaVals[n]);
+    }
+
+    // Removed blocks are left behind as zeroes, so keep them in check as in singleCCDr
+    current.compact(_SBM_MAX_DEAD_FRACTION_);
+    current.recomputeActiveSetSize(true);
+
+    ++pos;
+    return true;
+}
+
+std::size_t SolutionPath::Cursor::index() const{
+    return pos - 1;
+}
+
+double SolutionPath::Cursor::lambda() const{
+    return path->lambdas[pos - 1];
+}
+
+const SparseBlockMatrix& SolutionPath::Cursor::betas() const{
+    return current;
+}
+
+#endif
@@ -13,6 +13,7 @@
 #include <iostream>
 #include <algorithm>
 #include <math.h>
+#include <stdint.h>
 
 #include "defines.h"
 //#include "log.h"
@@ -68,6 +69,76 @@ extern double ZERO_THRESH; // defined in algorithm.h
 //       Finally, note that columns are always accessed "as-is", so there should be no confusion regarding column indices.
 //
 
+//
+// EDGE INDEX: find(row, col) is called for every pair visited by the CCDr algorithm. For columns with at most
+//   _SBM_INDEX_MIN_ROWS_ rows, a linear scan over rows[col] is as fast as anything else, but for high-degree nodes the
+//   scan grows with the degree. The rows of these columns are therefore also stored in an open-addressing hash table
+//   (linear probing, keyed on (row, col)) that maps each edge to its sparse row index, so that find is O(1) for all
+//   columns. A column is added to the index as soon as it has more than _SBM_INDEX_MIN_ROWS_ rows.
+//
+//   The sparse row indices only change in compact, or when addBlock restores a removed block (updateBlock only
+//   changes the values), so the index only has to be updated by addBlock (see indexEdge and moveEdge). clearBlocks
+//   does not touch rows, so the index stays valid. The index is rebuilt from scratch whenever the rows are set by one
+//   of the constructors or by compact (see rebuildIndex).
+//
+
+//
+// COMPACTION: A block stays in the structure after both of its values have returned to zero (a "dead" block), and
+//   all of the loops over the rows of a column keep visiting it. On a long path of lambdas the dead blocks pile up,
+//   so compact removes them from every column in which they make up more than a given fraction of the rows (and
+//   from the sibling columns), and fixes up the sibling indices in blocks. The remaining rows keep their relative
+//   order. The size of the active set is not affected: it counts every block that has been added, as if compact had
+//   never been called, so that the edge threshold of the algorithm (see CCDrAlgorithm) does not depend on how often
+//   betas is compacted.
+//
+//   The CCDr updates run down the rows of each column in order, so compaction must not change where a row would
+//   be if it had never been removed. Each column therefore remembers the rows it has lost, along with the position
+//   that they would have had (removedRows), and addBlock puts a removed block back in that position instead of at
+//   the end of the column. Apart from the dead blocks, the rows are then always in the same order as without
+//   compaction, and a block that is put back is not counted again. A removed row takes half the space of a stored
+//   one, but the list is never allowed to hold more rows than the columns themselves: a compaction that would go
+//   over this limit is skipped, which leaves the dead blocks where they are.
+//
+//   Since the sparse row indices change, any data that is indexed by them (e.g. GradientCache) has to be rebuilt
+//   or remapped afterwards (see the 'moved' output of compact); the same goes for addBlock when it restores a
+//   removed block (see isRemoved).
+//
+
+//
+// OWNERSHIP: The CCDr routines update betas in place (see singleCCDrInPlace in algorithm.h), since a copy of a
+//   SparseBlockMatrix costs O(pp + blocks). When a matrix has to change hands (e.g. to return a local matrix without
+//   a copy), swap exchanges the contents of two matrices in O(1); this is the C++98 equivalent of a move.
+//
+
+//
+// STORAGE: By default (_SBM_ARENA_ defined in defines.h), rows, vals and blocks are not stored as vectors of vectors
+//   but as three flat arrays (an "arena") that share the same layout, so that the jth column of each is the slab
+//   [colStart[j], colStart[j] + rowsizes(j)) of the corresponding array (i.e. a CSR-style struct of arrays). This
+//   saves the 3p separate heap allocations, makes copying a SparseBlockMatrix (e.g. for a snapshot of the estimate)
+//   three large memcpys, and keeps the columns close together in memory.
+//
+//   Each slab has some slack (colCap[j] >= rowsizes(j)) so that addBlock can usually append in place. When a slab
+//   is full, the column is moved to the end of the arena with twice the capacity, and its old slab becomes a hole.
+//   Once the holes take up more than half of the arena, the arena is compacted, i.e. every column is copied into a
+//   fresh arena in order, with _SBM_ARENA_SLACK_ free rows each (see growColumn and compactArena). Only the
+//   position of the slabs changes, so the sparse row indices (and hence blocks and the edge index) stay valid.
+//
+//   With _SBM_ARENA_ undefined, the original vectors of vectors are used instead. Both layouts have the same
+//   interface; the accessors are the only functions that depend on the layout (see benchmarks/sbm_layout.cpp).
+//
+
+//
+// BlockDelta
+//
+//   The change in the values of a block {a_ij, a_ji} made by addBlock / updateBlock: ij = new a_ij - old a_ij, and
+//   ji = new a_ji - old a_ji. Both functions are called for every pair visited by the CCDr algorithm, so the change
+//   is returned by value in a plain struct rather than in a (heap-allocated) vector.
+//
+struct BlockDelta{
+    double ij;
+    double ji;
+};
+
 //
 // nonzero
 //
@@ -101,6 +172,8 @@ public:
     double value(int j, int k) const;                       // get row value
     int block(int j, int k) const;                          // get sibling row index
     double sigma(int j) const;                              // get sigma value
+    const int* rowData(int j) const;                        // get the sparse row indices of column j (rowsizes(j) values)
+    const double* valueData(int j) const;                   // get the row values of column j (rowsizes(j) values)
     int find(int row, int col) const;                       // find the sparse row in rows[col] that holds the (row, col) element
     double findValue(int row, int col) const;               // find the edge weight that correspond to the (row, col) element
     double getSiblingValue(int j, int k) const;             // user-friendly getter for accessing sibling value
@@ -116,9 +189,12 @@ public:
     //
     void setValue(int j, int k, double v);                                          // set the value of an _existing_ edge in the model
     void setSigma(int j, double s);                                                 // set the value of a residual parameter (sigma)
-    std::vector<double> addBlock(int row, int col, double valij, double valji);     // add a new block (i.e. an edge) to the model with values 'valij', 'valji'
-    std::vector<double> updateBlock(int row, int col, double valij, double valji);  // update the value of an _existing_ block to the model with values 'valij', 'valji'
+    BlockDelta addBlock(int row, int col, double valij, double valji);             // add a new block (i.e. an edge) to the model with values 'valij', 'valji'
+    BlockDelta updateBlock(int row, int col, double valij, double valji);          // update the value of an _existing_ block to the model with values 'valij', 'valji'
     void clearBlocks();       // zeroes out and frees memory associated with blocks vector (which is not needed for storage and access)
+    int compact(double maxDeadFraction, std::vector< std::vector<int> >* moved = NULL);     // remove the zeroed-out blocks (see COMPACTION above)
+    bool isRemoved(int row, int col) const;                                         // true if the block (row, col) has been removed by compact
+    void swap(SparseBlockMatrix& other);                                            // exchange the contents of two matrices in O(1) (see OWNERSHIP above)
 
     //
     // Auxiliary member functions
@@ -140,18 +216,41 @@ public:
     //
     // Conversion to R List
     //
-    Rcpp::List get_R(double lambda_R = -1);
+    Rcpp::List get_R(double lambda_R = -1, bool blocks_R = true) const;
 #endif
 
 private:
     //
-    // The main components of the data structure
+    // The main components of the data structure (see STORAGE above)
     //
+#ifdef _SBM_ARENA_
+    std::vector<int> rows;                      // store the sparse row indices for each column (one slab per column)
+    std::vector<double> vals;                   // store the sparse row values for each column (same layout as rows)
+    std::vector<int> blocks;                    // store the row index for block siblings (same layout as rows)
+    std::vector<std::size_t> colStart;          // first entry of column j in rows / vals / blocks
+    std::vector<int> colSize;                   // number of rows in column j
+    std::vector<int> colCap;                    // capacity of the slab of column j
+    std::size_t arenaHoles;                     // number of entries in the arena that do not belong to any slab
+
+    void growColumn(int j);                     // make room for at least one more row in column j
+    void compactArena();                        // copy the slabs into a fresh arena without holes
+#else
     std::vector< std::vector<int> > rows;       // store the sparse row indices for each column
     std::vector< std::vector<double> > vals;    // store the sparse row values for each column
     std::vector< std::vector<int> > blocks;     // store the row index for block siblings
+#endif
     std::vector<double> sigmas;                 // store the residual values (sigmas) from the CCDr algorithm
 
+    void setColumns(const std::vector< std::vector<int> >& rows_in,         // replace the contents of rows / vals / blocks
+                    const std::vector< std::vector<double> >& vals_in,
+                    const std::vector< std::vector<int> >& blocks_in);
+    void appendRow(int j, int row, double val, int block);                  // add a new row to the end of column j
+    void insertRow(int j, int k, int row, double val, int block);           // add a new row to column j at sparse row k
+    void setBlock(int j, int k, int block);                                 // set the sibling index of an existing row
+    void getColumns(std::vector< std::vector<int> >& rows_out,              // copy rows / vals / blocks into vectors of vectors
+                    std::vector< std::vector<double> >& vals_out,
+                    std::vector< std::vector<int> >& blocks_out) const;
+
     //
     // Auxiliary variables
     //
@@ -159,6 +258,30 @@ private:
     int activeSetLength;                        // total number of nonzero edges in model (the "active set")
     std::vector<int> neighbourhoodSizes;        // store the number of parents for each node (the "neighbourhood")
 
+    //
+    // Rows removed by compact (see COMPACTION above): removedRows[j] holds (position, row) for each row removed from
+    //  column j, sorted by position, where position is the sparse row index the row would have without compaction
+    //  (empty until the first compaction)
+    //
+    std::vector< std::vector< std::pair<int, int> > > removedRows;
+    std::size_t nRemoved;                       // total number of rows in removedRows
+
+    int restoreRow(int row, int col);           // forget that (row, col) was removed and return its sparse row index
+
+    //
+    // Edge index for high-degree columns (see EDGE INDEX above)
+    //
+    std::vector<uint64_t> indexKeys;            // col * pp + row + 1 for each edge in the index, 0 = empty slot
+    std::vector<int> indexRows;                 // sparse row index of the edge stored in the same slot
+    std::size_t indexCount;                     // number of edges in the index
+    int indexBits;                              // indexKeys.size() = 2^indexBits (or zero if the index is empty)
+
+    std::size_t indexSlot(uint64_t key) const;  // first slot to probe for key
+    void indexEdge(int row, int col, int k);    // add the edge (row, col) with sparse row k to the index
+    void moveEdge(int row, int col, int k);     // point the edge (row, col) in the index at sparse row k
+    void indexColumn(int col);                  // add all of the edges in rows[col] to the index
+    void rebuildIndex();                        // rebuild the index from scratch
+
     //
     // Initialization method
     //
@@ -183,6 +306,7 @@ void SparseBlockMatrix::init(const std::vector< std::vector<int> >& rows_in,
     }
 
     activeSetLength = 0;                    // initialize this value zero, it will be updated as we update the data vectors
+    nRemoved = 0;
     pp = static_cast<int>(rows_in.size());  // the dimension should be equal to the number of vectors (e.g. at the first level) in any of rows / vals / blocks
     sigmas.resize(pp, 0);                   // reserve necessary memory for sigmas vector and initialize all values to zero
 
@@ -191,10 +315,8 @@ void SparseBlockMatrix::init(const std::vector< std::vector<int> >& rows_in,
     }
 
     // Populate the data structure using the supplied data
+    setColumns(rows_in, vals_in, blocks_in);
     for(int j = 0; j < pp; ++j){
-        rows.push_back(rows_in[j]);
-        vals.push_back(vals_in[j]);
-        blocks.push_back(blocks_in[j]);
         sigmas[j] = sigmas_in[j];
 
         // Update neighbourhood and active set sizes
@@ -207,6 +329,8 @@ void SparseBlockMatrix::init(const std::vector< std::vector<int> >& rows_in,
         neighbourhoodSizes.push_back(recomputeNeighbourhoodSize(j));
         activeSetLength += neighbourhoodSizes[j];
     }
+
+    rebuildIndex();
 }
 
 // Default constructor
@@ -215,17 +339,15 @@ void SparseBlockMatrix::init(const std::vector< std::vector<int> >& rows_in,
 //
 SparseBlockMatrix::SparseBlockMatrix(int sizeOfMatrix){
     activeSetLength = 0;    // since the matrix has no nonzero edges, its active set is empty
+    nRemoved = 0;
     pp = sizeOfMatrix;      // set the dimension appropriately
     sigmas.resize(pp, 0);   // reserve necessary memory for sigmas vector and initialize all values to zero
 
-    // Create empty vectors in each slot for rows / vals / blocks
-    for(int i = 0; i < pp; ++i){
-        rows.push_back(std::vector<int>(0));
-        vals.push_back(std::vector<double>(0));
-        blocks.push_back(std::vector<int>(0));
+    // Create empty columns for rows / vals / blocks
+    setColumns(std::vector< std::vector<int> >(pp), std::vector< std::vector<double> >(pp), std::vector< std::vector<int> >(pp));
+    neighbourhoodSizes.assign(pp, 0);
 
-        neighbourhoodSizes.push_back(0);
-    }
+    rebuildIndex();
 }
 
 // Explicit constructor
@@ -263,6 +385,19 @@ SparseBlockMatrix::SparseBlockMatrix(const std::vector< std::vector<int> >& rows
 
 // j = (true) column index
 // k = sparse row index
+#ifdef _SBM_ARENA_
+inline int SparseBlockMatrix::row(int j, int k) const{
+    return rows[colStart[j] + k];
+}
+
+inline double SparseBlockMatrix::value(int j, int k) const{
+    return vals[colStart[j] + k];
+}
+
+inline int SparseBlockMatrix::block(int j, int k) const{
+    return blocks[colStart[j] + k];
+}
+#else
 int SparseBlockMatrix::row(int j, int k) const{
     return rows[j][k];
 }
@@ -274,11 +409,32 @@ double SparseBlockMatrix::value(int j, int k) const{
 int SparseBlockMatrix::block(int j, int k) const{
     return blocks[j][k];
 }
+#endif
 
 double SparseBlockMatrix::sigma(int j) const{
     return sigmas[j];
 }
 
+// Raw access to the rows / values of column j, for the loops that run down a whole column (e.g. SigmaUpdater);
+//  the pointers are invalidated by addBlock and compact
+#ifdef _SBM_ARENA_
+const int* SparseBlockMatrix::rowData(int j) const{
+    return rows.empty() ? NULL : &rows[0] + colStart[j];
+}
+
+const double* SparseBlockMatrix::valueData(int j) const{
+    return vals.empty() ? NULL : &vals[0] + colStart[j];
+}
+#else
+const int* SparseBlockMatrix::rowData(int j) const{
+    return rows[j].empty() ? NULL : &rows[j][0];
+}
+
+const double* SparseBlockMatrix::valueData(int j) const{
+    return vals[j].empty() ? NULL : &vals[j][0];
+}
+#endif
+
 // Returns the sparse row index (i.e. in rows[col]) for the edge (row, col)
 //  If the requested edge is in the model, returns the sparse row
 //  Otherwise, returns -1
@@ -288,15 +444,27 @@ double SparseBlockMatrix::sigma(int j) const{
 //
 int SparseBlockMatrix::find(int row, int col) const{
 
-    int found = -1; // if found < 0, then the index was not found
-    for(int k = 0; k < rowsizes(col); ++k){
-        if(rows[col][k] == row){
-            found = k;
-            break;
+    // Low-degree columns are not in the index (see EDGE INDEX above)
+    if(rowsizes(col) <= _SBM_INDEX_MIN_ROWS_){
+        int found = -1; // if found < 0, then the index was not found
+        const int* colRows = rowData(col);
+        for(int k = 0; k < rowsizes(col); ++k){
+            if(colRows[k] == row){
+                found = k;
+                break;
+            }
         }
+
+        return found;
+    }
+
+    uint64_t key = static_cast<uint64_t>(col) * pp + row + 1;
+    std::size_t mask = indexKeys.size() - 1;
+    for(std::size_t slot = indexSlot(key); indexKeys[slot] != 0; slot = (slot + 1) & mask){
+        if(indexKeys[slot] == key) return indexRows[slot];
     }
 
-    return found;
+    return -1;
 }
 
 // Returns the value for the edge (row, col)
@@ -316,10 +484,10 @@ double SparseBlockMatrix::findValue(int row, int col) const{
             FILE_LOG(logWARNING) << "findValue called on edge which does not exist in model: " << "row = " << row << " col = " << col;
             return 0;
         } else{
-            return vals[col][sparse_row];
+            return value(col, sparse_row);
         }
     #else
-        return vals[col][find(row, col)];
+        return value(col, find(row, col));
     #endif
 }
 
@@ -329,14 +497,14 @@ double SparseBlockMatrix::getSiblingValue(int j, int k) const{
     // In DEBUG mode, check if k is not in rows[j]
     //
     #ifdef _DEBUG_ON_
-        if(k > rows[j].size()){
+        if(k > rowsizes(j)){
             FILE_LOG(logERROR) << "getSiblingValue called on edge which does not exist in model:";
             FILE_LOG(logERROR) << "(Sparse row) k = " << k << " (Column) j = " << j << std::endl;
             return 0;
         }
     #endif
 
-    return vals[rows[j][k]][blocks[j][k]];
+    return value(row(j, k), block(j, k));
 }
 
 // Check to see if node j has no parents in the model
@@ -348,9 +516,15 @@ bool SparseBlockMatrix::isEmpty(int j) const{
 }
 
 // Return the number of parents of node j in the model
+#ifdef _SBM_ARENA_
+inline int SparseBlockMatrix::rowsizes(int j) const{
+    return colSize[j];
+}
+#else
 int SparseBlockMatrix::rowsizes(int j) const{
     return static_cast<int>(rows[j].size());
 }
+#endif
 
 // Return the number of parents at node j
 int SparseBlockMatrix::neighbourhoodSize(int j) const{
@@ -365,8 +539,9 @@ int SparseBlockMatrix::recomputeNeighbourhoodSize(int j) const{
     //
     // Both are included below for testing purposes (which is faster???)
     //
-    int numZeroes = static_cast<int>(std::count(vals[j].begin(), vals[j].end(), 0));
-    int numNonZeroes = static_cast<int>(vals[j].size()) - numZeroes;
+    const double* colVals = valueData(j);
+    int numZeroes = static_cast<int>(std::count(colVals, colVals + rowsizes(j), 0));
+    int numNonZeroes = rowsizes(j) - numZeroes;
 
 //    int numNonZeroes = static_cast<int>(std::count_if(vals[j].begin(), vals[j].end(), nonzero));
 
@@ -379,8 +554,8 @@ int SparseBlockMatrix::recomputeNeighbourhoodSize(int j) const{
 
 
         nhbd_out << "Neighbourhood at X" << j << ": ";
-        for(int i = 0; i < vals[j].size(); ++i){
-            nhbd_out << vals[j][i] << " ";
+        for(int i = 0; i < rowsizes(j); ++i){
+            nhbd_out << value(j, i) << " ";
         }
         nhbd_out << " | " << numNonZeroes;
         FILE_LOG(logDEBUG4) << nhbd_out.str();
@@ -431,14 +606,18 @@ void SparseBlockMatrix::setValue(int j, int k, double v){
 
     #ifdef _DEBUG_ON_
         // in debug mode, check for existence of edge first
-        if(k >= rows[j].size()){
+        if(k >= rowsizes(j)){
             FILE_LOG(logERROR) << "Warning: setValue called on edge that does not exist in model!" << std::endl;
             FILE_LOG(logERROR) << ">>>>>>>> Killing function." << std::endl;
             return;
         }
     #endif
 
-    vals[j][k] = v;
+    #ifdef _SBM_ARENA_
+        vals[colStart[j] + k] = v;
+    #else
+        vals[j][k] = v;
+    #endif
 }
 
 // Update / set the jth sigma parameter
@@ -447,11 +626,11 @@ void SparseBlockMatrix::setSigma(int j, double s){
 }
 
 // Add a NEW block to the sparse-block structure
-//  Returns a vector containing the difference between the old values and the updated values; since
+//  Returns the difference between the old values and the updated values (see BlockDelta); since
 //  we are adding a block the "old values" are always zero and this is reflected in the calculations
 //
 // NOTE: row and col here refer to TRUE indices, not indices in the sparse structure
-std::vector<double> SparseBlockMatrix::addBlock(int row, int col, double valij, double valji){
+BlockDelta SparseBlockMatrix::addBlock(int row, int col, double valij, double valji){
 
     #ifdef _DEBUG_ON_
         if(find(row, col) >= 0){
@@ -462,41 +641,56 @@ std::vector<double> SparseBlockMatrix::addBlock(int row, int col, double valij,
         }
     #endif
 
-    rows[col].push_back(row); // add edge (row, col)
-    rows[row].push_back(col); // add edge (col, row)
+    int kcol = restoreRow(row, col), krow = restoreRow(col, row);
+    if(kcol < 0){
+        // The new rows go to the end of both columns, so each one's sibling is the last row of the other column
+        kcol = rowsizes(col);
+        krow = rowsizes(row);
+        appendRow(col, row, valij, krow); // add edge (row, col)
+        appendRow(row, col, valji, kcol); // add edge (col, row)
+    } else{
+        // A block removed by compact goes back where it was, and has already been counted (see COMPACTION above)
+        insertRow(col, kcol, row, valij, krow);
+        insertRow(row, krow, col, valji, kcol);
+        activeSetLength--;
+    }
+    activeSetLength++;   // don't forget to update the activeSet size
 
-    vals[col].push_back(valij);
-    vals[row].push_back(valji);
+    // Keep the edge index up to date: a column enters the index once it has more than _SBM_INDEX_MIN_ROWS_ rows
+    if(rowsizes(col) == _SBM_INDEX_MIN_ROWS_ + 1) indexColumn(col);
+    else if(rowsizes(col) > _SBM_INDEX_MIN_ROWS_ + 1){
+        for(int k = kcol + 1; k < rowsizes(col); ++k) moveEdge(this->row(col, k), col, k);
+        indexEdge(row, col, kcol);
+    }
 
-    // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-    // Check these calculations
-    // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-    blocks[col].push_back(static_cast<int>(rows[row].size()) - 1);
-    blocks[row].push_back(static_cast<int>(rows[col].size()) - 1);
-    activeSetLength++;   // don't forget to update the activeSet size
+    if(rowsizes(row) == _SBM_INDEX_MIN_ROWS_ + 1) indexColumn(row);
+    else if(rowsizes(row) > _SBM_INDEX_MIN_ROWS_ + 1){
+        for(int k = krow + 1; k < rowsizes(row); ++k) moveEdge(this->row(row, k), row, k);
+        indexEdge(col, row, krow);
+    }
 
     // NOTE: These values may be negative; it is up to the getError() function to implement the desired error function
     //        (e.g. L1, L2, etc)
-    std::vector<double> err(2, 0);
-    err[0] = valij;     // Since we are adding a new block, the old coefficient values must be zero,
-    err[1] = valji;     //  so err[0] = valij - 0 = valij (similarly for err[1])
+    BlockDelta err;
+    err.ij = valij;     // Since we are adding a new block, the old coefficient values must be zero,
+    err.ji = valji;     //  so err.ij = valij - 0 = valij (similarly for err.ji)
 
     return err;
 }
 
 // Update an EXISTING block in the sparse-block structure
-//  Returns a vector containing the difference between the old values and the updated values
+//  Returns the difference between the old values and the updated values (see BlockDelta)
 //
 // NOTE: j and k here do not refer to true indices, but indices in the sparse structure
 //       j = COLUMN index
 //       k = sparse ROW index
-std::vector<double> SparseBlockMatrix::updateBlock(int j, int k, double valij, double valji){
+BlockDelta SparseBlockMatrix::updateBlock(int j, int k, double valij, double valji){
 
     #ifdef _DEBUG_ON_
-        if(k >= rows[j].size()){
+        if(k >= rowsizes(j)){
             FILE_LOG(logERROR) << "Warning: updateBlock called on edge that does not exist in model!" << std::endl;
             FILE_LOG(logERROR) << ">>>>>>>> Killing function." << std::endl;
-            std::vector<double> err(2, 0);
+            BlockDelta err = {0, 0};
             return err;
         }
     #endif
@@ -504,22 +698,22 @@ std::vector<double> SparseBlockMatrix::updateBlock(int j, int k, double valij, d
     // Need to store the current values before updating so we can compute the error below
     //  NOTE: This is not actually necessary, since we can compute the error BEFORE updating. If
     //        efficiency becomes a concern here we can make this change.
-    double oldij = vals[j][k];
+    double oldij = value(j, k);
     double oldji = getSiblingValue(j, k);
 
     #ifdef _DEBUG_ON_
-        FILE_LOG(logDEBUG2) << "Updating block at (" << rows[j][k] << ", " << j << "):  " << oldij << " / " << oldji << " --> " << valij << " / " << valji;
+        FILE_LOG(logDEBUG2) << "Updating block at (" << row(j, k) << ", " << j << "):  " << oldij << " / " << oldji << " --> " << valij << " / " << valji;
     #endif
 
     // Update the values
     setValue(j, k, valij);
-    setValue(rows[j][k], blocks[j][k], valji);
+    setValue(row(j, k), block(j, k), valji);
 
     // NOTE: These values may be negative; it is up to the getError() function to implement the desired error function
     //        (e.g. L1, L2, etc)
-    std::vector<double> err(2, 0);
-    err[0] = valij - oldij;
-    err[1] = valji - oldji;
+    BlockDelta err;
+    err.ij = valij - oldij;
+    err.ji = valji - oldji;
 
     return err;
 }
@@ -533,11 +727,410 @@ void SparseBlockMatrix::clearBlocks(){
         OUTPUT << "Clearing all data associated with blocks vector for this matrix.";
     #endif
 
-    // Clear all the internal vectors associated with blocks
-    for(int i = 0; i < pp; ++i) blocks[i].clear();
+    #ifdef _SBM_ARENA_
+        // The blocks share the layout of rows / vals, so the whole array can go at once
+        std::vector<int>().swap(blocks);
+    #else
+        // Clear all the internal vectors associated with blocks
+        for(int i = 0; i < pp; ++i) blocks[i].clear();
+
+        // Clear the entire blocks vector itself
+        blocks.clear();
+    #endif
+}
 
-    // Clear the entire blocks vector itself
-    blocks.clear();
+// Exchanges the contents of this matrix with those of other (no data is copied)
+void SparseBlockMatrix::swap(SparseBlockMatrix& other){
+    rows.swap(other.rows);
+    vals.swap(other.vals);
+    blocks.swap(other.blocks);
+    #ifdef _SBM_ARENA_
+        colStart.swap(other.colStart);
+        colSize.swap(other.colSize);
+        colCap.swap(other.colCap);
+        std::swap(arenaHoles, other.arenaHoles);
+    #endif
+    sigmas.swap(other.sigmas);
+
+    std::swap(pp, other.pp);
+    std::swap(activeSetLength, other.activeSetLength);
+    neighbourhoodSizes.swap(other.neighbourhoodSizes);
+    removedRows.swap(other.removedRows);
+    std::swap(nRemoved, other.nRemoved);
+
+    indexKeys.swap(other.indexKeys);
+    indexRows.swap(other.indexRows);
+    std::swap(indexCount, other.indexCount);
+    std::swap(indexBits, other.indexBits);
+}
+
+// Removes the dead blocks (both values exactly zero) from every column in which they make up more than
+//  maxDeadFraction of the rows, and from the sibling columns of these blocks
+//  Returns the number of blocks removed (zero if removedRows would outgrow the columns, see COMPACTION above)
+//
+//  If moved != NULL, (*moved)[j][k] is set to the new sparse row index of the old row k of column j (or -1 if the
+//  row was removed) for every column j that has changed; (*moved)[j] is empty for the other columns
+//
+// NOTE: The blocks vector is needed to find the siblings, so this cannot be called after clearBlocks
+int SparseBlockMatrix::compact(double maxDeadFraction, std::vector< std::vector<int> >* moved){
+    if(moved != NULL) moved->assign(pp, std::vector<int>());
+
+    // Find the columns with too many dead blocks
+    std::vector<char> flagged(pp, 0);
+    bool any = false;
+    for(int j = 0; j < pp; ++j){
+        int dead = 0;
+        for(int k = 0; k < rowsizes(j); ++k){
+            if(value(j, k) == 0 && getSiblingValue(j, k) == 0) ++dead;
+        }
+
+        if(dead > 0 && dead > maxDeadFraction * rowsizes(j)){
+            flagged[j] = 1;
+            any = true;
+        }
+    }
+    if(!any) return 0;
+
+    // New sparse row index of every row (-1 = removed); a dead block goes if either of its columns is flagged
+    std::vector< std::vector<int> > newIndex(pp);
+    std::vector<char> changed(pp, 0);
+    int removed = 0;
+    for(int j = 0; j < pp; ++j){
+        newIndex[j].resize(rowsizes(j));
+
+        int next = 0;
+        for(int k = 0; k < rowsizes(j); ++k){
+            int i = row(j, k);
+            if((flagged[j] || flagged[i]) && value(j, k) == 0 && getSiblingValue(j, k) == 0){
+                newIndex[j][k] = -1;
+                changed[j] = 1;
+                if(j > i) ++removed;
+            } else{
+                newIndex[j][k] = next++;
+            }
+        }
+    }
+
+    // Keep removedRows within the number of rows that are left (see COMPACTION above)
+    std::size_t stored = 0;
+    for(int j = 0; j < pp; ++j) stored += rowsizes(j);
+    if(nRemoved + 2 * static_cast<std::size_t>(removed) > stored - 2 * static_cast<std::size_t>(removed)) return 0;
+
+    #ifdef _DEBUG_ON_
+        FILE_LOG(logDEBUG1) << "Removing " << removed << " dead blocks from the model.";
+        int activeSetBefore = activeSetLength;
+    #endif
+
+    // Remember where the removed rows were, counting the rows that earlier compactions have removed
+    if(removedRows.empty()) removedRows.resize(pp);
+    for(int j = 0; j < pp; ++j){
+        if(!changed[j]) continue;
+
+        std::vector< std::pair<int, int> > merged;
+        std::size_t r = 0;
+        int position = 0;
+        for(int k = 0; k < rowsizes(j); ++k, ++position){
+            while(r < removedRows[j].size() && removedRows[j][r].first == position){
+                merged.push_back(removedRows[j][r++]);
+                ++position;
+            }
+            if(newIndex[j][k] < 0) merged.push_back(std::make_pair(position, row(j, k)));
+        }
+        merged.insert(merged.end(), removedRows[j].begin() + r, removedRows[j].end());
+        removedRows[j].swap(merged);
+    }
+    nRemoved += 2 * static_cast<std::size_t>(removed);
+
+    // Copy the remaining rows, pointing each one at the new position of its sibling
+    std::vector< std::vector<int> > rows_out(pp), blocks_out(pp);
+    std::vector< std::vector<double> > vals_out(pp);
+    for(int j = 0; j < pp; ++j){
+        int size = rowsizes(j) - static_cast<int>(std::count(newIndex[j].begin(), newIndex[j].end(), -1));
+        rows_out[j].reserve(size);
+        vals_out[j].reserve(size);
+        blocks_out[j].reserve(size);
+
+        for(int k = 0; k < rowsizes(j); ++k){
+            if(newIndex[j][k] < 0) continue;
+
+            rows_out[j].push_back(row(j, k));
+            vals_out[j].push_back(value(j, k));
+            blocks_out[j].push_back(newIndex[row(j, k)][block(j, k)]);
+        }
+    }
+
+    setColumns(rows_out, vals_out, blocks_out);
+    rebuildIndex();
+
+    //
+    // In DEBUG mode, check that every removed row went to removedRows, and that the active set is untouched
+    //
+    #ifdef _DEBUG_ON_
+        std::size_t left = 0, listed = 0;
+        for(int j = 0; j < pp; ++j){
+            left += rowsizes(j);
+            listed += removedRows[j].size();
+        }
+        if(left + listed != stored + nRemoved - 2 * static_cast<std::size_t>(removed) || listed != nRemoved || activeSetLength != activeSetBefore){
+            FILE_LOG(logERROR) << "compact lost track of the removed rows: " << left << " rows left, " << listed << " in removedRows (nRemoved = " << nRemoved << ")";
+            FILE_LOG(logERROR) << "    " << stored << " rows before, active set size " << activeSetBefore << " -> " << activeSetLength;
+        }
+    #endif
+
+    if(moved != NULL){
+        for(int j = 0; j < pp; ++j){
+            if(changed[j]) (*moved)[j].swap(newIndex[j]);
+        }
+    }
+
+    return removed;
+}
+
+// Returns true if the block (row, col) has been removed by compact and has not been added back since
+bool SparseBlockMatrix::isRemoved(int row, int col) const{
+    if(removedRows.empty()) return false;
+
+    for(std::size_t r = 0; r < removedRows[col].size(); ++r){
+        if(removedRows[col][r].second == row) return true;
+    }
+
+    return false;
+}
+
+// If (row, col) has been removed by compact, drops it from removedRows[col] and returns the sparse row index at which
+//  it has to be put back so that it comes after the same rows as before (see COMPACTION above); otherwise returns -1
+int SparseBlockMatrix::restoreRow(int row, int col){
+    if(removedRows.empty()) return -1;
+
+    std::vector< std::pair<int, int> >& removed = removedRows[col];
+    for(std::size_t r = 0; r < removed.size(); ++r){
+        if(removed[r].second != row) continue;
+
+        // The rows that are still removed and come before this one are not in the column
+        int k = removed[r].first - static_cast<int>(r);
+        removed.erase(removed.begin() + r);
+        --nRemoved;
+
+        return k;
+    }
+
+    return -1;
+}
+
+//
+// Storage helpers: these (and the accessors above) are the only functions that depend on the layout of rows / vals /
+//  blocks (see STORAGE above)
+//
+#ifdef _SBM_ARENA_
+void SparseBlockMatrix::setColumns(const std::vector< std::vector<int> >& rows_in,
+                                   const std::vector< std::vector<double> >& vals_in,
+                                   const std::vector< std::vector<int> >& blocks_in){
+    int ncols = static_cast<int>(rows_in.size());
+    colStart.resize(ncols);
+    colSize.resize(ncols);
+    colCap.resize(ncols);
+
+    std::size_t length = 0;
+    for(int j = 0; j < ncols; ++j){
+        colStart[j] = length;
+        colSize[j] = static_cast<int>(rows_in[j].size());
+        colCap[j] = colSize[j] + _SBM_ARENA_SLACK_;
+        length += colCap[j];
+    }
+
+    bool withBlocks = !blocks_in.empty(); // blocks may have been cleared (see clearBlocks)
+    rows.assign(length, 0);
+    vals.assign(length, 0);
+    blocks.assign(withBlocks ? length : 0, 0);
+    arenaHoles = 0;
+
+    for(int j = 0; j < ncols; ++j){
+        std::copy(rows_in[j].begin(), rows_in[j].end(), rows.begin() + colStart[j]);
+        std::copy(vals_in[j].begin(), vals_in[j].end(), vals.begin() + colStart[j]);
+        if(withBlocks) std::copy(blocks_in[j].begin(), blocks_in[j].end(), blocks.begin() + colStart[j]);
+    }
+}
+
+inline void SparseBlockMatrix::appendRow(int j, int row, double val, int block){
+    if(colSize[j] == colCap[j]) growColumn(j);
+
+    std::size_t pos = colStart[j] + colSize[j];
+    rows[pos] = row;
+    vals[pos] = val;
+    blocks[pos] = block;
+    ++colSize[j];
+}
+
+// The rows after k move down by one, so their siblings are pointed at their new positions
+void SparseBlockMatrix::insertRow(int j, int k, int row, double val, int block){
+    if(colSize[j] == colCap[j]) growColumn(j);
+
+    std::size_t pos = colStart[j] + k, end = colStart[j] + colSize[j];
+    std::copy_backward(rows.begin() + pos, rows.begin() + end, rows.begin() + end + 1);
+    std::copy_backward(vals.begin() + pos, vals.begin() + end, vals.begin() + end + 1);
+    std::copy_backward(blocks.begin() + pos, blocks.begin() + end, blocks.begin() + end + 1);
+    rows[pos] = row;
+    vals[pos] = val;
+    blocks[pos] = block;
+    ++colSize[j];
+
+    for(int m = k + 1; m < colSize[j]; ++m) setBlock(this->row(j, m), this->block(j, m), m);
+}
+
+inline void SparseBlockMatrix::setBlock(int j, int k, int block){
+    blocks[colStart[j] + k] = block;
+}
+
+// Moves column j to the end of the arena with twice its capacity; a column that is already at the end is simply
+//  extended in place. Before a move that would leave more than half of the arena in holes, the arena is compacted.
+void SparseBlockMatrix::growColumn(int j){
+    if(colStart[j] + colCap[j] != rows.size() && 2 * (arenaHoles + colCap[j]) > rows.size()){
+        compactArena();
+        if(colSize[j] < colCap[j]) return;
+    }
+
+    int newCap = 2 * colCap[j] + _SBM_ARENA_SLACK_;
+    if(colStart[j] + colCap[j] == rows.size()){
+        rows.resize(colStart[j] + newCap, 0);
+        vals.resize(colStart[j] + newCap, 0);
+        blocks.resize(colStart[j] + newCap, 0);
+    } else{
+        std::size_t start = rows.size();
+        rows.resize(start + newCap, 0);
+        vals.resize(start + newCap, 0);
+        blocks.resize(start + newCap, 0);
+
+        std::copy(rows.begin() + colStart[j], rows.begin() + colStart[j] + colSize[j], rows.begin() + start);
+        std::copy(vals.begin() + colStart[j], vals.begin() + colStart[j] + colSize[j], vals.begin() + start);
+        std::copy(blocks.begin() + colStart[j], blocks.begin() + colStart[j] + colSize[j], blocks.begin() + start);
+
+        arenaHoles += colCap[j];
+        colStart[j] = start;
+    }
+
+    colCap[j] = newCap;
+}
+
+void SparseBlockMatrix::compactArena(){
+    std::vector< std::vector<int> > rows_out, blocks_out;
+    std::vector< std::vector<double> > vals_out;
+    getColumns(rows_out, vals_out, blocks_out);
+    setColumns(rows_out, vals_out, blocks_out);
+}
+
+void SparseBlockMatrix::getColumns(std::vector< std::vector<int> >& rows_out,
+                                   std::vector< std::vector<double> >& vals_out,
+                                   std::vector< std::vector<int> >& blocks_out) const{
+    rows_out.resize(colStart.size());
+    vals_out.resize(colStart.size());
+    blocks_out.resize(blocks.empty() ? 0 : colStart.size());
+
+    for(std::size_t j = 0; j < colStart.size(); ++j){
+        rows_out[j].assign(rows.begin() + colStart[j], rows.begin() + colStart[j] + colSize[j]);
+        vals_out[j].assign(vals.begin() + colStart[j], vals.begin() + colStart[j] + colSize[j]);
+        if(!blocks.empty()) blocks_out[j].assign(blocks.begin() + colStart[j], blocks.begin() + colStart[j] + colSize[j]);
+    }
+}
+#else
+void SparseBlockMatrix::setColumns(const std::vector< std::vector<int> >& rows_in,
+                                   const std::vector< std::vector<double> >& vals_in,
+                                   const std::vector< std::vector<int> >& blocks_in){
+    rows = rows_in;
+    vals = vals_in;
+    blocks = blocks_in;
+}
+
+inline void SparseBlockMatrix::appendRow(int j, int row, double val, int block){
+    rows[j].push_back(row);
+    vals[j].push_back(val);
+    blocks[j].push_back(block);
+}
+
+// The rows after k move down by one, so their siblings are pointed at their new positions
+void SparseBlockMatrix::insertRow(int j, int k, int row, double val, int block){
+    rows[j].insert(rows[j].begin() + k, row);
+    vals[j].insert(vals[j].begin() + k, val);
+    blocks[j].insert(blocks[j].begin() + k, block);
+
+    for(int m = k + 1; m < rowsizes(j); ++m) setBlock(this->row(j, m), this->block(j, m), m);
+}
+
+inline void SparseBlockMatrix::setBlock(int j, int k, int block){
+    blocks[j][k] = block;
+}
+
+void SparseBlockMatrix::getColumns(std::vector< std::vector<int> >& rows_out,
+                                   std::vector< std::vector<double> >& vals_out,
+                                   std::vector< std::vector<int> >& blocks_out) const{
+    rows_out = rows;
+    vals_out = vals;
+    blocks_out = blocks;
+}
+#endif
+
+// Fibonacci hashing: the top indexBits bits of key * 2^64 / golden ratio
+inline std::size_t SparseBlockMatrix::indexSlot(uint64_t key) const{
+    return static_cast<std::size_t>((key * 0x9E3779B97F4A7C15ULL) >> (64 - indexBits));
+}
+
+// Add the edge (row, col) to the index, doubling the size of the table whenever it is more than half full
+void SparseBlockMatrix::indexEdge(int row, int col, int k){
+    if(2 * (indexCount + 1) > indexKeys.size()){
+        std::vector<uint64_t> oldKeys;
+        std::vector<int> oldRows;
+        oldKeys.swap(indexKeys);
+        oldRows.swap(indexRows);
+
+        indexBits = (indexBits == 0) ? 6 : indexBits + 1;
+        indexKeys.assign(static_cast<std::size_t>(1) << indexBits, 0);
+        indexRows.assign(indexKeys.size(), -1);
+
+        std::size_t mask = indexKeys.size() - 1;
+        for(std::size_t s = 0; s < oldKeys.size(); ++s){
+            if(oldKeys[s] == 0) continue;
+
+            std::size_t slot = indexSlot(oldKeys[s]);
+            while(indexKeys[slot] != 0) slot = (slot + 1) & mask;
+            indexKeys[slot] = oldKeys[s];
+            indexRows[slot] = oldRows[s];
+        }
+    }
+
+    uint64_t key = static_cast<uint64_t>(col) * pp + row + 1;
+    std::size_t mask = indexKeys.size() - 1;
+    std::size_t slot = indexSlot(key);
+    while(indexKeys[slot] != 0) slot = (slot + 1) & mask;
+
+    indexKeys[slot] = key;
+    indexRows[slot] = k;
+    ++indexCount;
+}
+
+// The edge must already be in the index
+void SparseBlockMatrix::moveEdge(int row, int col, int k){
+    uint64_t key = static_cast<uint64_t>(col) * pp + row + 1;
+    std::size_t mask = indexKeys.size() - 1;
+    std::size_t slot = indexSlot(key);
+    while(indexKeys[slot] != key) slot = (slot + 1) & mask;
+
+    indexRows[slot] = k;
+}
+
+void SparseBlockMatrix::indexColumn(int col){
+    for(int k = 0; k < rowsizes(col); ++k){
+        indexEdge(row(col, k), col, k);
+    }
+}
+
+void SparseBlockMatrix::rebuildIndex(){
+    indexKeys.clear();
+    indexRows.clear();
+    indexCount = 0;
+    indexBits = 0;
+
+    for(int j = 0; j < pp; ++j){
+        if(rowsizes(j) > _SBM_INDEX_MIN_ROWS_) indexColumn(j);
+    }
 }
 
 // Returns the dimension of the model (e.g. number of nodes)
@@ -550,15 +1143,15 @@ void SparseBlockMatrix::print() const{
     for(int i = 0; i < pp; ++i){
         for(int j = 0; j < pp; ++j){
             int found = -1;
-            for(int k = 0; k < rows[j].size(); ++k){
-                if(rows[j][k] == i){
+            for(int k = 0; k < rowsizes(j); ++k){
+                if(row(j, k) == i){
                     found = k;
                     break;
                 }
             }
 
             if(found >= 0)
-                printf("%8.2f",  vals[j][found]);
+                printf("%8.2f",  value(j, found));
             else
                 printf("%8d", 0);
 
@@ -575,15 +1168,15 @@ void SparseBlockMatrix::print(int r) const{
     for(int i = 0; i < r; ++i){
         for(int j = 0; j < r; ++j){
             int found = -1;
-            for(int k = 0; k < rows[j].size(); ++k){
-                if(rows[j][k] == i){
+            for(int k = 0; k < rowsizes(j); ++k){
+                if(row(j, k) == i){
                     found = k;
                     break;
                 }
             }
 
             if(found >= 0)
-                printf("%8.2f",  vals[j][found]);
+                printf("%8.2f",  value(j, found));
             else
                 printf("%8d", 0);
 
@@ -606,6 +1199,7 @@ void SparseBlockMatrix::print(int r) const{
         }
 
         activeSetLength = 0; // initialize to zero
+        nRemoved = 0;
         pp = rows_in.size();
         sigmas.resize(pp, 0); // reserve necessary memory for sigmas vector and initialize all values to zero
 
@@ -614,17 +1208,25 @@ void SparseBlockMatrix::print(int r) const{
         }
 
         // Collect the internal vectors inside each R list to populate the data structure
+        std::vector< std::vector<int> > rows_vec(pp), blocks_vec(pp);
+        std::vector< std::vector<double> > vals_vec(pp);
         for(int j = 0; j < pp; ++j){
             // Us as<> to convert R vectors to C++ STL vectors
-            rows.push_back(Rcpp::as< std::vector<int> >(rows_in[j]));
-            vals.push_back(Rcpp::as< std::vector<double> >(vals_in[j]));
-            blocks.push_back(Rcpp::as< std::vector<int> >(blocks_in[j]));
+            rows_vec[j] = Rcpp::as< std::vector<int> >(rows_in[j]);
+            vals_vec[j] = Rcpp::as< std::vector<double> >(vals_in[j]);
+            blocks_vec[j] = Rcpp::as< std::vector<int> >(blocks_in[j]);
+        }
+        setColumns(rows_vec, vals_vec, blocks_vec);
+
+        for(int j = 0; j < pp; ++j){
             sigmas[j] = sigmas_in[j];
 
             // Update neighbourhood and active set sizes
             neighbourhoodSizes.push_back(recomputeNeighbourhoodSize(j));
             activeSetLength += neighbourhoodSizes[j];
         }
+
+        rebuildIndex();
     }
 
     // Takes in an R list containing the components of an R SparseBlockMatrix object:
@@ -9,8 +9,8 @@
 //------------------------------------------------------------------------------/
 //
 // IMPORTANT NOTES FOR RCPP COMPILATION:
-//  1) Functions that return Rcpp objects (e.g. List, NumericVector, etc.) should
-//      NOT be const -- right now this affects the get_R function
+//  1) Functions that return Rcpp objects (e.g. List, NumericVector, etc.) can be
+//      const, since wrap copies its input -- e.g. SparseBlockMatrix::get_R
 //  2) Need to employ 'using namespace std;' unless we want to add a whole lot of
 //      Rcpp::
 //
@@ -27,8 +27,18 @@
 #include "defines.h"
 //#include "Auxiliary.h"
 #include "SparseBlockMatrix.h"
+#include "PackedSymmetricMatrix.h"
+#include "SolutionPath.h"
 #include "PenaltyFunction.h"
 #include "CCDrAlgorithm.h"
+#include "CycleChecker.h"
+#include "PairScreen.h"
+#include "KKTCache.h"
+#include "GradientCache.h"
+#include "EdgeLossCache.h"
+#include "EdgeColouring.h"
+#include "CoordinateOrder.h"
+#include "SigmaUpdater.h"
 //#include "log.h" // moved to defines.h
 #include "debug.h"
 
@@ -40,7 +50,6 @@
 //   GLOBAL VARIABLES
 //
 double ZERO_THRESH = 1e-12;
-// const int MAX_CCS_ARRAY_SIZE = 4000; // upper bound on the array size used in checkCycleSparse
 
 #ifdef _DEBUG_ON_
     int ccdinit_calls = 0, ccd_calls = 0, ccs_calls = 0, spu_calls = 0, spuV_calls = 0;
@@ -53,25 +62,51 @@ double ZERO_THRESH = 1e-12;
 //   MAIN CCDR CODE
 //------------------------------------------------------------------------------/
 
+//
+// The main routines are templates over the type used to store the correlations (CorMatrix), so that each storage
+//   mode gets its own fully inlined copy of the hot loops. Any type providing 'double value(a, b) const' can be used,
+//   e.g. PackedSymmetricMatrix or PackedSymmetricMatrixFloat (see PackedSymmetricMatrix.h).
+//
+
 // prototype for gridCCDr
-std::vector<SparseBlockMatrix> gridCCDr(const std::vector<double>& cors,    // array containing the correlations between predictors
-                                        SparseBlockMatrix betas,            // initial guess of beta matrix
-                                        const unsigned int nn,              // # of rows in data matrix
-                                        const std::vector<double>& lambdas, // vector containing the grid of regularization parameters to be tested
-                                        const std::vector<double>& params,  // vector containing user-defined parameters: {gamma, eps, maxIters, alpha}
-                                        const int verbose                   // binary variable to specify whether or not to print progress reports
-                                        );
+template <typename CorMatrix>
+SolutionPath gridCCDr(const CorMatrix& cors,              // array containing the correlations between predictors
+                      SparseBlockMatrix& betas,           // initial guess of beta matrix (overwritten with the last estimate)
+                      const unsigned int nn,              // # of rows in data matrix
+                      const std::vector<double>& lambdas, // vector containing the grid of regularization parameters to be tested
+                      const std::vector<double>& params,  // vector containing user-defined parameters: {gamma, eps, maxIters, alpha}
+                      const int verbose,                  // binary variable to specify whether or not to print progress reports
+                      const bool screened = false,        // screen the pairs with the strong rule (see PairScreen.h)
+                      std::vector<int>* violations = NULL // if not NULL, the number of KKT violations found for each lambda is appended here
+                      );
+
+// prototype for singleCCDrInPlace
+template <typename CorMatrix>
+void singleCCDrInPlace(const CorMatrix& cors,               // array containing the correlations between predictors
+                       SparseBlockMatrix& betas,            // initial guess of beta matrix (overwritten with the estimate)
+                       const unsigned int nn,               // # of rows in data matrix
+                       const double lambda,                 // value of regularization parameter
+                       const std::vector<double>& params,   // vector containing user-defined parameters: {gamma, eps, maxIters, alpha}
+                       const int verbose,                   // binary variable to specify whether or not to print progress reports
+                       PairScreen* screen = NULL,           // strong rule screen (only used by gridCCDr)
+                       CCDrCounters* counters = NULL,       // if not NULL, the sweep / update counts of this run are added here
+                       KKTCache* kktCache = NULL            // certificates shared across calls (NULL = a new cache for this call only)
+);
 
 // prototype for singleCCDr
-SparseBlockMatrix singleCCDr(const std::vector<double>& cors,   // array containing the correlations between predictors
+template <typename CorMatrix>
+SparseBlockMatrix singleCCDr(const CorMatrix& cors,             // array containing the correlations between predictors
                              SparseBlockMatrix betas,           // initial guess of beta matrix
                              const unsigned int nn,             // # of rows in data matrix
                              const double lambda,               // value of regularization parameter
                              const std::vector<double>& params, // vector containing user-defined parameters: {gamma, eps, maxIters, alpha}
-                             const int verbose                  // binary variable to specify whether or not to print progress reports
+                             const int verbose,                 // binary variable to specify whether or not to print progress reports
+                             PairScreen* screen = NULL,         // strong rule screen (only used by gridCCDr)
+                             CCDrCounters* counters = NULL      // if not NULL, the sweep / update counts of this run are added here
 );
 
 // prototype for computeEdgeLoss
+template <typename CorMatrix>
 void computeEdgeLoss(const double betaUpdate,           // proposed new value of beta_ab
                      const unsigned int a,              // initial node (i.e. update beta_ab)
                      const unsigned int b,              // terminal node (i.e. update beta_ab)
@@ -79,56 +114,114 @@ void computeEdgeLoss(const double betaUpdate,           // proposed new value of
                      const unsigned int nn,             // # of rows in data matrix
                      SparseBlockMatrix& betas,          // current value of beta matrix
                      const PenaltyFunction& pen,        // penalty function
-                     const std::vector<double>& cors,   // array containing the correlations between predictors
+                     const CorMatrix& cors,             // array containing the correlations between predictors
                      double S[],                        // values of the loglikelihood function in the given block
-                     const int verbose                  // binary variable to specify whether or not to print progress reports
+                     const int verbose,                 // binary variable to specify whether or not to print progress reports
+                     EdgeLossCache* losses = NULL       // cached loss terms of each column (NULL = computed from scratch)
 );
 
 // prototype for concaveCDInit
+template <typename CorMatrix>
 void concaveCDInit(const double lambda,                         // value of regularization parameter
                    const unsigned int nn,                       // # of rows in data matrix
                    SparseBlockMatrix& betas,                    // current value of beta matrix
                    CCDrAlgorithm& alg,                          // CCDrAlgorithm object for this run
+                   CycleChecker& ccs,                           // topological order used by checkCycleSparse
+                   PairScreen* screen,                          // pairs to visit (NULL = all pairs)
+                   KKTCache* kkt,                               // certificates of the zero pairs (NULL = visit every pair)
+                   EdgeLossCache* losses,                       // cached loss terms of each column (see computeEdgeLoss)
+                   SigmaUpdater* sigmas,                        // stale sigmas (NULL = recompute every sigma)
                    const PenaltyFunction& pen,                  // penalty function
-                   const std::vector<double>& cors,             // array containing the correlations between predictors
+                   const CorMatrix& cors,                       // array containing the correlations between predictors
                    const int verbose                            // binary variable to specify whether or not to print progress reports
 );
 
+// prototype for updateSigmas
+template <typename CorMatrix>
+void updateSigmas(const unsigned int nn,                        // # of rows in data matrix
+                  SparseBlockMatrix& betas,                     // current value of beta matrix
+                  const CCDrAlgorithm& alg,                     // CCDrAlgorithm object for this run
+                  KKTCache* kkt,                                // drift of the columns (NULL = not tracked)
+                  SigmaUpdater* sigmas,                         // stale sigmas (NULL = recompute every sigma)
+                  const CorMatrix& cors                         // array containing the correlations between predictors
+);
+
+// prototype for screenPairs
+template <typename CorMatrix>
+int screenPairs(const double lambda,                            // value of regularization parameter
+                const SparseBlockMatrix& betas,                 // current value of beta matrix
+                const CorMatrix& cors,                          // array containing the correlations between predictors
+                PairScreen& screen                              // candidate pairs for the current / next lambda
+);
+
 // prototype for concaveCD
+template <typename CorMatrix>
 void concaveCD(const double lambda,                             // value of regularization parameter
                const unsigned int nn,                           // # of rows in data matrix
                SparseBlockMatrix& betas,                        // current value of beta matrix
                CCDrAlgorithm& alg,                              // CCDrAlgorithm object for this run
+               KKTCache* kkt,                                   // drift of the columns (NULL = not tracked)
+               GradientCache* grad,                             // cached partial products Sigma * beta (NULL = not used)
+               EdgeLossCache* losses,                           // cached loss terms of each column (see computeEdgeLoss)
+               SigmaUpdater* sigmas,                            // stale sigmas (NULL = recompute every sigma)
+               CoordinateOrder* order,                          // order of the updates (NULL = cyclic)
                const PenaltyFunction& pen,                      // penalty function
-               const std::vector<double>& cors,                 // array containing the correlations between predictors
+               const CorMatrix& cors,                           // array containing the correlations between predictors
                const int verbose                                // binary variable to specify whether or not to print progress reports
                );
 
+// prototype for updateActiveBlock
+template <typename CorMatrix>
+double updateActiveBlock(const unsigned int j,                    // column of the block
+                         const unsigned int rowIdx,               // sparse row of the block in column j
+                         const double lambda,                     // value of regularization parameter
+                         const unsigned int nn,                   // # of rows in data matrix
+                         SparseBlockMatrix& betas,                // current value of beta matrix
+                         KKTCache* kkt,                           // drift of the columns (NULL = not tracked)
+                         GradientCache* grad,                     // cached partial products Sigma * beta (NULL = not used)
+                         EdgeLossCache* losses,                   // cached loss terms of each column (NULL = not used)
+                         SigmaUpdater* sigmas,                    // stale sigmas (NULL = not tracked)
+                         const PenaltyFunction& pen,              // penalty function
+                         const CorMatrix& cors,                   // array containing the correlations between predictors
+                         const int verbose                        // binary variable to specify whether or not to print progress reports
+                         );
+
+//prototype for singleResidual
+template <typename CorMatrix>
+double singleResidual(const unsigned int a,                     // initial node (i.e. residual factor for beta_ab)
+                      const unsigned int b,                     // terminal node (i.e. residual factor for beta_ab)
+                      const SparseBlockMatrix& betas,           // current value of beta matrix
+                      const CorMatrix& cors                     // array containing the correlations between predictors
+);
+
 //prototype for singleUpdate
+template <typename CorMatrix>
 double singleUpdate(const unsigned int a,                       // initial node (i.e. update beta_ab)
                     const unsigned int b,                       // terminal node (i.e. update beta_ab)
                     const double lambda,                        // value of regularization parameter
                     const unsigned int nn,                      // # of rows in data matrix
                     const SparseBlockMatrix& betas,             // current value of beta matrix
                     const PenaltyFunction& pen,                 // penalty function
-                    const std::vector<double>& cors,            // array containing the correlations between predictors
-                    const int verbose                           // binary variable to specify whether or not to print progress reports
+                    const CorMatrix& cors,                      // array containing the correlations between predictors
+                    const int verbose,                          // binary variable to specify whether or not to print progress reports
+                    double* res = NULL                          // if not NULL, the residual factor res_ab is stored here
 );
 
 //prototype for singleUpdateV
+template <typename CorMatrix>
 double singleUpdateV(const unsigned int a,                       // initial node (i.e. update beta_ab)
                      const unsigned int b,                       // terminal node (i.e. update beta_ab)
                      const double lambda,                        // value of regularization parameter
                      const unsigned int nn,                      // # of rows in data matrix
                      SparseBlockMatrix& betas,                   // current value of beta matrix
                      const PenaltyFunction& pen,                 // penalty function
-                     const std::vector<double>& cors,            // array containing the correlations between predictors
+                     const CorMatrix& cors,                      // array containing the correlations between predictors
                      double S[],                                 // for storing the values of S1, S2
                      const int verbose                           // binary variable to specify whether or not to print progress reports
 );
 
 //prototype for checkCycleSparse
-bool checkCycleSparse(const int node,                    // number of nodes in graph (i.e. node = pp)
+bool checkCycleSparse(CycleChecker& ccs,                 // scratch space for the search (see CycleChecker.h)
                       const SparseBlockMatrix& betas,    // sparse matrix structure
                       int a,                             // initial node
                       int b                              // terminal node
@@ -142,30 +235,49 @@ bool checkCycleSparse(const int node,                    // number of nodes in g
 //     guaranteed to be zero, and then the value of lambda decreases as the algorithm proceeds, allowing more and
 //     more edges into the model.
 //
-//   Output: A vector of SparseBlockMatrix objects, one estimate for each value of lambda in lambdas
+//   Output: A SolutionPath holding one estimate for each value of lambda in lambdas (stored as the differences
+//     between consecutive estimates; see SolutionPath.h)
 //
 //   NOTES:
 //     -betas and lambdas can be anything to start with
+//     -betas is updated in place, i.e. on return it holds the estimate for the last lambda that was computed; the
+//       path only stores the changes between estimates, so betas is never copied
 //     -the C++ code enforces no defaults; these are all implemented in R
 //     -it is very important that the params values are passed in the CORRECT ORDER: {gamma, eps, maxIters, alpha}
+//     -two more values may optionally be appended: {..., nthreads, jacobi} (see concaveCDInit and concaveCD); the
+//       default is a single thread
+//     -a seventh value selects the order of the updates in concaveCD: 0 = cyclic (default), 1 = random, 2 = greedy
+//       (see CoordinateOrder.h)
+//     -an eighth value overrides the fraction of dead blocks that triggers a compaction of betas (default
+//       _SBM_MAX_DEAD_FRACTION_; >= 1 turns compaction off, see SparseBlockMatrix::compact)
+//     -by default, the path is the same as calling singleCCDr for each lambda in turn; with screened = true, the
+//       pairs visited by the full sweeps are screened (see PairScreen.h), so the path may differ slightly; the number
+//       of discarded pairs that failed the KKT check for each lambda is reported in violations (always zero when
+//       screened = false)
+//     -a single KKTCache (see KKTCache.h) is kept for the whole grid, instead of allocating one for each lambda
 //
-std::vector<SparseBlockMatrix> gridCCDr(const std::vector<double>& cors,
-                                        SparseBlockMatrix betas,
-                                        const unsigned int nn,
-                                        const std::vector<double>& lambdas,
-                                        const std::vector<double>& params,
-                                        const int verbose
-                                        ){
+template <typename CorMatrix>
+SolutionPath gridCCDr(const CorMatrix& cors,
+                      SparseBlockMatrix& betas,
+                      const unsigned int nn,
+                      const std::vector<double>& lambdas,
+                      const std::vector<double>& params,
+                      const int verbose,
+                      const bool screened,
+                      std::vector<int>* violations
+                      ){
     #ifdef _DEBUG_ON_
         FILE_LOG(logDEBUG2) << "Function call: gridCCDr";
     #endif
 
     int nlam = static_cast<int>(lambdas.size());    // how many values of lambda are in the supplied grid?
     double alpha = params[3];                       // value of alpha; needed to know when to terminate algorithm
-    std::vector<SparseBlockMatrix> grid_betas;      // the vector of SBMs that will eventually be returned
+    SolutionPath grid_betas(betas.dim());           // the path of estimates that will eventually be returned
+    PairScreen screen = PairScreen(betas.dim());    // strong rule screen for the pairs visited by concaveCDInit
+    KKTCache KKT = KKTCache(betas.dim());           // certificates of the zero pairs, carried over from one lambda to the next
 
     //
-    // This function is simple: Simply call singleCCDr repeatedly for each value of lambda supplied
+    // This function is simple: Simply call singleCCDrInPlace repeatedly for each value of lambda supplied
     //
     for(int l = 0; l < nlam; ++l){
         double lambda = lambdas[l]; // current value of lambda in the grid
@@ -180,10 +292,15 @@ std::vector<SparseBlockMatrix> gridCCDr(const std::vector<double>& cors,
         }
         //--------------------//
 
+        // The strong rule for the next lambda is applied at the end of singleCCDrInPlace
+        screen.setNextLambda((l + 1 < nlam) ? lambdas[l + 1] : -1);
+
         // To save memory, simply overwrite the same object (betas)
-        // After each call to singleCCDr, we push_back the estimated object to grid_betas so there is no loss of data
-        betas = singleCCDr(cors, betas, nn, lambda, params, verbose);
-        grid_betas.push_back(betas);
+        // After each call to singleCCDrInPlace, we push_back the changes to the estimate to grid_betas so there is no loss of data
+        std::size_t found = screen.violations();
+        singleCCDrInPlace(cors, betas, nn, lambda, params, verbose, screened ? &screen : NULL, NULL, &KKT);
+        grid_betas.push_back(betas, lambda);
+        if(violations != NULL) violations->push_back(static_cast<int>(screen.violations() - found));
 
         //--- VERBOSE ONLY ---//
         if(verbose){
@@ -198,11 +315,6 @@ std::vector<SparseBlockMatrix> gridCCDr(const std::vector<double>& cors,
         }
         //--------------------//
 
-        // Once an estimate has been computed, the blocks vector is superfluous and so we get rid of it to save memory
-        // This is negligible for small models, but in order to push the limits of the algorithm (i.e. pp in thousands+)
-        //   we need to save memory wherever possible
-        grid_betas[l].clearBlocks();
-
         if(betas.activeSetSize() >= alpha * betas.dim()){
             break;
         }
@@ -212,37 +324,67 @@ std::vector<SparseBlockMatrix> gridCCDr(const std::vector<double>& cors,
 }
 
 //
-// singleCCDr
+// singleCCDrInPlace / singleCCDr
 //
 //   Computes a single CCDr estimate based on an initial guess (betas) and a single value of lambda. This is _NOT_
 //     what is usually meant by the "CCDr algorithm". In particular, note that the use of a full grid, starting with
 //     the zero matrix and lambda_max = sqrt(n) is pivotal to returning accurate results with CCDr. This function
 //     mostly defined to encapsulate the behaviour of the algorithm for a single lambda.
 //
-//   Output: A single SparseBlockMatrix object, representing the estimate (Phi(lambda), R(lambda))
+//   Output: None; betas is overwritten with the estimate (Phi(lambda), R(lambda)). singleCCDr is the same, except that
+//     it takes a copy of betas and returns the estimate as a new SparseBlockMatrix.
 //
 //   NOTES:
 //     -betas and lambda can be anything to start with
 //     -the C++ code enforces no defaults; these are all implemented in R
 //     -it is very important that the params values are passed in the CORRECT ORDER: {gamma, eps, maxIters, alpha}
+//     -two more values may optionally be appended: {..., nthreads, jacobi} (see concaveCDInit and concaveCD); the
+//       default is a single thread
+//     -a seventh value selects the order of the updates in concaveCD: 0 = cyclic (default), 1 = random, 2 = greedy
+//       (see CoordinateOrder.h)
+//     -an eighth value overrides the fraction of dead blocks that triggers a compaction of betas (default
+//       _SBM_MAX_DEAD_FRACTION_; >= 1 turns compaction off, see SparseBlockMatrix::compact)
 //
-SparseBlockMatrix singleCCDr(const std::vector<double>& cors,
+template <typename CorMatrix>
+SparseBlockMatrix singleCCDr(const CorMatrix& cors,
                              SparseBlockMatrix betas,
                              const unsigned int nn,
                              const double lambda,
                              const std::vector<double>& params,
-                             const int verbose
+                             const int verbose,
+                             PairScreen* screen,
+                             CCDrCounters* counters
                              ){
+    singleCCDrInPlace(cors, betas, nn, lambda, params, verbose, screen, counters);
+
+    // betas is a parameter, so hand its contents over to a local to avoid a copy on return
+    SparseBlockMatrix estimate(0);
+    estimate.swap(betas);
+
+    return estimate;
+}
+
+template <typename CorMatrix>
+void singleCCDrInPlace(const CorMatrix& cors,
+                       SparseBlockMatrix& betas,
+                       const unsigned int nn,
+                       const double lambda,
+                       const std::vector<double>& params,
+                       const int verbose,
+                       PairScreen* screen,
+                       CCDrCounters* counters,
+                       KKTCache* kktCache
+                       ){
     #ifdef _DEBUG_ON_
-        FILE_LOG(logDEBUG2) << "Function call: singleCCDr";
+        FILE_LOG(logDEBUG2) << "Function call: singleCCDrInPlace";
         FILE_LOG(logDEBUG1) << "Number of nonzero entries: " << betas.activeSetSize();
     #endif
 
     //
     // Set parameters for algorithm
     //
-    if(params.size() != 4){
-        OUTPUT << "Parameter vector 'params' should have exactly four elements! Check your input." << std::endl;
+    if(params.size() != 4 && params.size() != 6 && params.size() != 7 && params.size() != 8){
+        OUTPUT << "Parameter vector 'params' should have exactly four (or six, seven or eight) elements! Check your input." << std::endl;
     }
 
     double gammaMCP = params[0];  // set parameter for penalty function
@@ -254,46 +396,100 @@ SparseBlockMatrix singleCCDr(const std::vector<double>& cors,
     // Create some critical objects for the algorithm
     //
     CCDrAlgorithm CCDR = CCDrAlgorithm(maxIters, eps, alpha, betas.dim());  // to keep track of the algorithm's progress
+    if(params.size() >= 6){
+        CCDR.nthreads = static_cast<int>(params[4]);
+        CCDR.jacobi = (params[5] != 0);
+    }
     PenaltyFunction MCP = PenaltyFunction(gammaMCP);                        // to compute MCP function
+    CycleChecker CCS = CycleChecker(betas);                                 // to check for cycles (keeps a topological order of betas)
+    KKTCache LOCAL_KKT = KKTCache(kktCache == NULL ? betas.dim() : 0);      // to skip pairs that are certain to stay zero
+    KKTCache& KKT = (kktCache == NULL) ? LOCAL_KKT : *kktCache;
+    KKTCache* kkt = KKT.enabled() ? &KKT : NULL;
+    KKT.setLambda(lambda);
+    GradientCache GRAD = GradientCache(betas.dim());                        // to make the updates in concaveCD O(1)
+    CoordinateOrder ORDER = CoordinateOrder(betas.dim(),                    // order of the updates in concaveCD
+                                            params.size() >= 7 ? static_cast<CoordinateOrder::Policy>(static_cast<int>(params[6])) : CoordinateOrder::CYCLIC);
+    EdgeLossCache LOSSES = EdgeLossCache(betas.dim(), lambda);              // to avoid recomputing the loss of each column in computeEdgeLoss
+    SigmaUpdater SIGMAS = SigmaUpdater(betas.dim());                        // to only recompute the sigmas of the columns that have changed
+    std::vector< std::vector<int> > moved;                                  // rows moved by the last compaction of betas
+    double maxDeadFraction = params.size() >= 8 ? params[7] : _SBM_MAX_DEAD_FRACTION_;
+    double startTime = CCDrCounters::now();
 
     //
     // Begin the main part of the algorithm
     //
 
-    // The active set hasn't actually changed, but this guarantees that as long as the first pass of
-    //  concaveCDInit doesn't add too many edges, the algorithm will do at least one sweep over the
-    //  initial active set to update the edge values
-    CCDR.activeSetChanged();
-    do{
-        //
-        // Once we have run a full sweep over all active blocks, reset the stop flags to be zero
-        //  and do another full sweep using concaveCDInit. If the active set changes, we keep going,
-        //  otherwise, we terminate.
-        //
-        CCDR.resetFlags();
+    //
+    // When the pairs are screened (see PairScreen.h), the KKT conditions of the discarded pairs are checked once the
+    //  algorithm has converged. Any violators are added to the candidates and the algorithm is run again.
+    //
+    bool checkedKKT = false;
+    for(;;){
+        // The active set hasn't actually changed, but this guarantees that as long as the first pass of
+        //  concaveCDInit doesn't add too many edges, the algorithm will do at least one sweep over the
+        //  initial active set to update the edge values
+        CCDR.activeSetChanged();
+        do{
+            //
+            // Once we have run a full sweep over all active blocks, reset the stop flags to be zero
+            //  and do another full sweep using concaveCDInit. If the active set changes, we keep going,
+            //  otherwise, we terminate.
+            //
+            CCDR.resetFlags();
 
-        // This pass runs over all blocks
-        concaveCDInit(lambda, nn, betas, CCDR, MCP, cors, verbose);
+            //
+            // Drop the blocks that have been zeroed out since they were added (see SparseBlockMatrix::compact). This
+            //  moves rows around; the gradient cache is rebuilt before concaveCD anyway, and ORDER matches the rows
+            //  by their row index. The other terms do not change, since only zeroes are removed, but they are
+            //  refreshed so that they are summed in the new order.
+            //
+            if(betas.compact(maxDeadFraction, &moved) > 0){
+                for(int j = 0; j < betas.dim(); ++j){
+                    if(moved[j].empty()) continue;
 
-        //
-        // ADD EXTRA ALGORITHM CHECKS HERE IF NEEDED
-        //
+                    LOSSES.columnChanged(j);
+                    SIGMAS.columnChanged(j);
+                }
+            }
 
-        // As long as new edges have been added and we have not exceeded the maximum number of allowed edges,
-        //   continue with single parameter updates for all active edges
-        if(CCDR.keepGoing()){
-            // block for running the rest of the CD iterations over the given active set
-            int iters = 1; // we already ran one pass to determine the active set
-            while( CCDR.moar(iters)){
-                concaveCD(lambda, nn, betas, CCDR, MCP, cors, verbose);
-                iters++;
+            // This pass runs over all blocks (or over the candidates of the screen)
+            concaveCDInit(lambda, nn, betas, CCDR, CCS, screen, kkt, &LOSSES, &SIGMAS, MCP, cors, verbose);
+
+            //
+            // ADD EXTRA ALGORITHM CHECKS HERE IF NEEDED
+            //
+
+            // As long as new edges have been added and we have not exceeded the maximum number of allowed edges,
+            //   continue with single parameter updates for all active edges
+            if(CCDR.keepGoing()){
+                // block for running the rest of the CD iterations over the given active set
+                int iters = 1; // we already ran one pass to determine the active set
+
+                // concaveCDInit may have changed the structure of betas, so the cached gradients are rebuilt here
+                GradientCache* grad = GRAD.rebuild(betas, cors) ? &GRAD : NULL;
+                while( CCDR.moar(iters)){
+                    concaveCD(lambda, nn, betas, CCDR, kkt, grad, &LOSSES, &SIGMAS, &ORDER, MCP, cors, verbose);
+                    CCDR.addIter();
+                    iters++;
+                }
             }
-        }
 
-        // we have finished a full sweep
-        CCDR.addSweep();
+            // we have finished a full sweep
+            CCDR.addSweep();
+
+        } while( CCDR.keepGoing());
 
-    } while( CCDR.keepGoing());
+        // No need to check the KKT conditions if this estimate is going to be discarded anyway
+        if(screen == NULL || betas.activeSetSize() > CCDR.edgeThreshold()) break;
+
+        checkedKKT = true;
+        if(screenPairs(lambda, betas, cors, *screen) == 0) break;
+    }
+
+    // Apply the strong rule for the next lambda (this was done by the last call to screenPairs)
+    if(screen != NULL){
+        screen->advance(checkedKKT && screen->nextLambda() >= 0 && 2 * screen->nextLambda() - lambda > 0);
+    }
 
 #ifdef _DEBUG_ON_
     std::ostringstream final_out;
@@ -302,8 +498,19 @@ SparseBlockMatrix singleCCDr(const std::vector<double>& cors,
     final_out << "#    Summary                                         \n";
     final_out << "# lambda = " << lambda << std::endl;
     final_out << "# Total number of calls to concaveCDInit: " << ccdinit_calls << std::endl;
+    final_out << "# Sweeps / passes over the active set / single parameter updates: " << CCDR.getSweeps() << " / " << CCDR.getIters() << " / " << CCDR.getUpdates() << std::endl;
     final_out << "# Total number of calls to concaveCD: " << ccd_calls << std::endl;
     final_out << "# Total number of calls to checkCycleSparse: " << ccs_calls << std::endl;
+    final_out << "#   settled by topological order: " << CCS.orderHits() << std::endl;
+    final_out << "#   settled by reachability cache (hits / misses): " << CCS.cacheHits() << " / " << CCS.cacheMisses() << std::endl;
+    final_out << "#   settled by search: " << CCS.searches() << std::endl;
+    if(screen != NULL){
+        final_out << "# Candidate pairs for next lambda: " << screen->candidates() << " (total KKT violations: " << screen->violations() << ")" << std::endl;
+    }
+    final_out << "# Pairs skipped by KKT certificates (so far): " << KKT.skipped() << std::endl;
+    final_out << "# Rebuilds of the gradient cache: " << GRAD.rebuilds() << std::endl;
+    final_out << "# Columns refreshed in the edge loss cache: " << LOSSES.refreshes() << std::endl;
+    final_out << "# Sigmas recomputed / skipped: " << SIGMAS.updates() << " / " << SIGMAS.skipped() << " (" << SIGMAS.seconds() << "s of " << CCDrCounters::now() - startTime << "s)" << std::endl;
     final_out << "# Total number of calls to singleUpdate: " << spu_calls << std::endl;
     final_out << "# Total number of calls to singleUpdateV: " << spuV_calls << std::endl;
     final_out << "#####################################################\n";
@@ -313,7 +520,15 @@ SparseBlockMatrix singleCCDr(const std::vector<double>& cors,
     FILE_LOG(logINFO) << final_out.str();
 #endif
 
-    return betas;
+    if(counters != NULL){
+        counters->sweeps += CCDR.getSweeps();
+        counters->iters += CCDR.getIters();
+        counters->updates += CCDR.getUpdates();
+        counters->sigmas += SIGMAS.updates();
+        counters->sigmasSkipped += SIGMAS.skipped();
+        counters->seconds += CCDrCounters::now() - startTime;
+        counters->sigmaSeconds += SIGMAS.seconds();
+    }
 }
 
 //
@@ -334,12 +549,37 @@ SparseBlockMatrix singleCCDr(const std::vector<double>& cors,
 //          *randomly
 //     -we also update sigmas before betas: what is the effect of swapping these?
 //
+//   PARALLEL PROPOSALS: When alg.nthreads != 1 (and OpenMP is available), each row i is processed in two phases.
+//     First the residual factors res_ij and res_ji of all pairs in the row (the "proposals") are computed in
+//     parallel; this only reads betas. The pairs are then committed one at a time in the usual order (cycle check,
+//     computeEdgeLoss, addBlock / updateBlock), so the result never depends on the number of threads.
+//
+//     Within row i, res_ij only depends on column j, which is only changed by the pair (i, j) itself, while res_ji
+//     depends on column i, which changes whenever a pair in the row changes beta_ji. By default (alg.jacobi =
+//     false), every res_ji proposed before such a change is recomputed at commit time, so the sweep is exactly the
+//     same as the serial (Gauss-Seidel) sweep. With alg.jacobi = true the stale proposals are used as they are
+//     (Jacobi-style), which keeps all of the work in the parallel phase but may change the path of the algorithm.
+//     The Jacobi proposals are computed in the same way with a single thread, so the result does not depend on the
+//     number of threads either.
+//
+//     Rows with fewer than _PARALLEL_SWEEP_MIN_PAIRS_ pairs are always processed serially.
+//
+//     NOTE: The proposals call cors.value() from several threads at once, so CorMatrix must be safe to read
+//            concurrently. LazyCorrelationMatrix is not, so gridCCDrLazy (see rcpp_wrap.cpp) always runs with
+//            nthreads = 1.
+//
+template <typename CorMatrix>
 void concaveCDInit(const double lambda,
                    const unsigned int nn,
                    SparseBlockMatrix& betas,
                    CCDrAlgorithm& alg,
+                   CycleChecker& ccs,
+                   PairScreen* screen,
+                   KKTCache* kkt,
+                   EdgeLossCache* losses,
+                   SigmaUpdater* sigmas,
                    const PenaltyFunction& pen,
-                   const std::vector<double>& cors,
+                   const CorMatrix& cors,
                    const int verbose
                    ){
 
@@ -349,6 +589,7 @@ void concaveCDInit(const double lambda,
     #endif
 
     alg.resetError(); // sets maxAbsError = 0
+    ccs.newSweep();   // concaveCD may have removed edges since the last sweep, so the cached ancestor sets are stale
 
     double S[2] = {0, 0};   // to store the values of the loglikelihood when comparing edges in a block; use an array instead of a vector for efficiency (faster initialization)
 
@@ -358,25 +599,9 @@ void concaveCDInit(const double lambda,
 
     //
     // Compute sigmas
-    //   See Section 4.2.2. of the computational paper for the details of this calculation
+    //   See Section 4.2.2. of the computational paper for the details of this calculation (see SigmaUpdater.h)
     //
-    for(unsigned int j = 0; j < betas.dim(); ++j){
-
-        double c = 0;
-        for(unsigned int l = 0; l < betas.rowsizes(j); ++l){
-            unsigned int row = betas.row(j, l);
-
-            if(j <= row){
-                c += betas.value(j, l) * cors[(j + row*(row+1)/2)]; // c += beta_ij * <xj,xi>
-            }
-            else{
-                c += betas.value(j, l) * cors[(row + j*(j+1)/2)];   // c += beta_ij * <xj,xi> (also)
-            }
-        }
-
-        double s = 0.5 * (1.0 * c + sqrt(c * c + 4 * nn));
-        betas.setSigma(j, s);
-    } // end for loop for sigmas
+    updateSigmas(nn, betas, alg, kkt, sigmas, cors);
 
     #ifdef _DEBUG_ON_
         std::ostringstream sigma_out;
@@ -397,22 +622,96 @@ void concaveCDInit(const double lambda,
     //        For example, edges in the first row (resp. first column) are much more likely to be nonzero than later edges.
     //        Consider how to fix this, e.g. by RANDOMIZING the order of the updates.
     // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+    //
+    // If the pairs are screened, only the candidates (and the pairs that already have a block) are visited, in the
+    //  same order as the full sweep
+    //
     unsigned int pp = betas.dim();
+
+    // Scratch space for the parallel proposals (see PARALLEL PROPOSALS above)
+    int nthreads = 1;
+    #ifdef _OPENMP
+        nthreads = (alg.nthreads <= 0) ? omp_get_max_threads() : alg.nthreads;
+    #endif
+    std::vector<double> proposals;
+    std::vector<char> proposed;
+    if(nthreads > 1 || alg.jacobi){
+        proposals.resize(2 * pp);
+        proposed.resize(pp);
+    }
+
     for(unsigned int i = 0; i < pp; ++i){
-    	for(unsigned int j = i + 1; j < pp; ++j){
+        const std::vector<int>* cols = NULL;
+        unsigned int ncols = pp - i - 1;
+        if(screen != NULL && screen->active()){
+            cols = &screen->pairs(i, betas);
+            ncols = cols->size();
+        }
+
+        // Proposal phase
+        bool parallelRow = ((nthreads > 1 || alg.jacobi) && ncols >= _PARALLEL_SWEEP_MIN_PAIRS_);
+        bool columnChanged = false; // has column i changed since the proposals were computed?
+
+        if(parallelRow){
+            #ifdef _OPENMP
+            #pragma omp parallel for schedule(static) num_threads(nthreads)
+            #endif
+            for(long n = 0; n < static_cast<long>(ncols); ++n){
+                unsigned int j = (cols == NULL) ? i + 1 + n : (*cols)[n];
+
+                // Pairs that are certified now will most likely still be certified at commit time
+                proposed[n] = !(kkt != NULL && kkt->certified(i, j));
+                if(proposed[n]){
+                    proposals[2 * n] = singleResidual(i, j, betas, cors);
+                    proposals[2 * n + 1] = singleResidual(j, i, betas, cors);
+                }
+            }
+        }
+
+        // Commit phase
+    	for(unsigned int n = 0; n < ncols; ++n){
+            unsigned int j = (cols == NULL) ? i + 1 + n : (*cols)[n];
+
+            // Skip the pair if both updates are certain to be zero (see KKTCache.h); visiting it would not change betas
+            if(kkt != NULL && kkt->certified(i, j)){
+                kkt->addSkipped();
+                if(betas.activeSetSize() <= alg.edgeThreshold()) alg.belowThreshold();
+                continue;
+            }
+            alg.addUpdates(2);
+
+            double resij = 0, resji = 0;
+            double betaUpdateij, betaUpdateji;
+            bool staleji = false; // true if resji is a stale Jacobi proposal
+            if(parallelRow && proposed[n]){
+                resij = proposals[2 * n];
+                if(columnChanged && !alg.jacobi){
+                    resji = singleResidual(j, i, betas, cors);
+                } else{
+                    resji = proposals[2 * n + 1];
+                    staleji = columnChanged;
+                }
 
-            double betaUpdateij = singleUpdate(i, j, lambda, nn, betas, pen, cors, verbose);
-            double betaUpdateji = singleUpdate(j, i, lambda, nn, betas, pen, cors, verbose);
+                betaUpdateij = pen.threshold(resij, lambda);
+                betaUpdateji = pen.threshold(resji, lambda);
+            } else{
+                betaUpdateij = singleUpdate(i, j, lambda, nn, betas, pen, cors, verbose, &resij);
+                betaUpdateji = singleUpdate(j, i, lambda, nn, betas, pen, cors, verbose, &resji);
+            }
             bool hasCycleij = false, hasCycleji = false;
 
+            // The margins are those of the current betas, so they must be stored before the pair is updated (a stale
+            //  proposal does not certify anything)
+            if(kkt != NULL) kkt->certify(i, j, lambda - fabs(resij), staleji ? -HUGE_VAL : lambda - fabs(resji));
+
             if(fabs(betaUpdateij) > ZERO_THRESH){
-                hasCycleij = checkCycleSparse(pp, betas, i, j);
+                hasCycleij = checkCycleSparse(ccs, betas, i, j);
             }
 
             if(fabs(betaUpdateji) > ZERO_THRESH){
                 // If adding i->j induces a cycle, then j->i cannot induce a cycle, so we can skip checking in this case
                 if(!hasCycleij){
-                    hasCycleji = checkCycleSparse(pp, betas, j, i);
+                    hasCycleji = checkCycleSparse(ccs, betas, j, i);
                 }
             }
 
@@ -422,7 +721,7 @@ void concaveCDInit(const double lambda,
                 betaUpdateji = 0.0;
             } else{
                 // single parameter update for beta_ji
-                computeEdgeLoss(betaUpdateji, j, i, lambda, nn, betas, pen, cors, S, verbose);
+                computeEdgeLoss(betaUpdateji, j, i, lambda, nn, betas, pen, cors, S, verbose, losses);
                 double S1ji = S[0]; // Qi|betaji=0
                 double S2ji = S[1]; // Qi|betaji=betaUpdate
 
@@ -431,7 +730,7 @@ void concaveCDInit(const double lambda,
             #endif
 
                 // single parameter update for beta_ij
-                computeEdgeLoss(betaUpdateij, i, j, lambda, nn, betas, pen, cors, S, verbose);
+                computeEdgeLoss(betaUpdateij, i, j, lambda, nn, betas, pen, cors, S, verbose, losses);
                 double S1ij = S[1]; // Qj|betaij=betaUpdate
                 double S2ij = S[0]; // Qj|betaij=0
 
@@ -476,8 +775,8 @@ void concaveCDInit(const double lambda,
             // Sparse update for i->j
             unsigned int row = i, col = j;
 
-            int found = betas.find(row, col); // potential bottleneck in the code!
-            std::vector<double> err(2, 0);
+            int found = betas.find(row, col); // O(1), see EDGE INDEX in SparseBlockMatrix.h
+            BlockDelta err = {0, 0};
 
             if(found >= 0){
                 // if the block exists in the sparse matrix, update it's value
@@ -509,9 +808,11 @@ void concaveCDInit(const double lambda,
                 // !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
                 if(fabs(betas.findValue(row, col)) > ZERO_THRESH && fabs(betaUpdateij) < ZERO_THRESH){
                     alg.activeSetChanged(); // since we removed an edge to the model, the active set has changed
+                    ccs.removeEdge(j);
                 }
                 if(fabs(betas.findValue(col, row)) > ZERO_THRESH && fabs(betaUpdateji) < ZERO_THRESH){
                     alg.activeSetChanged(); // since we removed an edge to the model, the active set has changed
+                    ccs.removeEdge(i);
                 }
 
                 err = betas.updateBlock(col, found, betaUpdateij, betaUpdateji);
@@ -524,8 +825,20 @@ void concaveCDInit(const double lambda,
             } else{
                 // only add a block if the update is nonzero
                 if(fabs(betaUpdateij) > ZERO_THRESH || fabs(betaUpdateji) > ZERO_THRESH){
+                    // A block that was only removed by compact would have been updated in place above, which does
+                    //  not count as a change of the active set (see COMPACTION in SparseBlockMatrix.h)
+                    if(!betas.isRemoved(row, col)) alg.activeSetChanged(); // since we added an edge to the model, the active set has changed
                     err = betas.addBlock(row, col, betaUpdateij, betaUpdateji);
-                    alg.activeSetChanged(); // since we added an edge to the model, the active set has changed
+
+                    // Both columns have a new row (even if one of the values is zero)
+                    if(losses != NULL){
+                        losses->columnChanged(i);
+                        losses->columnChanged(j);
+                    }
+                    if(sigmas != NULL){
+                        sigmas->columnChanged(i);
+                        sigmas->columnChanged(j);
+                    }
 
                     #ifdef _DEBUG_ON_
                         if(betas.dim() <= 5){
@@ -536,11 +849,32 @@ void concaveCDInit(const double lambda,
                 }
             }
 
+            if(kkt != NULL){
+                kkt->columnChanged(j, err.ij);
+                kkt->columnChanged(i, err.ji);
+            }
+            if(err.ji != 0) columnChanged = true;
+            if(losses != NULL){
+                if(err.ij != 0) losses->columnChanged(j);
+                if(err.ji != 0) losses->columnChanged(i);
+            }
+            if(sigmas != NULL){
+                if(err.ij != 0) sigmas->columnChanged(j);
+                if(err.ji != 0) sigmas->columnChanged(i);
+            }
+
+            //
+            // Keep the topological order used by checkCycleSparse up to date (removed edges have already been
+            //   reported above)
+            //
+            if(fabs(betaUpdateij) > ZERO_THRESH) ccs.addEdge(betas, i, j);
+            if(fabs(betaUpdateji) > ZERO_THRESH) ccs.addEdge(betas, j, i);
+
             //
             // Update the accumulated error
             //
-            alg.updateError(err[0]);
-            alg.updateError(err[1]);
+            alg.updateError(err.ij);
+            alg.updateError(err.ji);
 
             #ifdef _DEBUG_ON_
                 FILE_LOG(logDEBUG4) << "activeSetLength = " << betas.activeSetSize();
@@ -577,13 +911,26 @@ void concaveCDInit(const double lambda,
 //          ***THIS IS THE OPPOSITE OF CONCAVECDINIT
 //     -would allowing random order affect the results?
 //     -since we are not adding any new edges, the order of sigmas/betas should not matter here
+//     -if grad != NULL, the residual factors are read from the cache in O(1) instead of calling singleUpdate, and the
+//       cache is kept up to date after each update (see GradientCache.h)
+//     -with alg.jacobi = true, the blocks are updated in (parallel) batches instead (see below)
+//     -otherwise, the blocks may also be visited in random or greedy order (see CoordinateOrder.h); in that case the
+//       size of each update is added to the error of alg, so that singleCCDr keeps passing over the active set until
+//       the updates have converged (see CCDrAlgorithm::moar). The cyclic and Jacobi passes do not track the error,
+//       so they stop after a single pass as before.
 //
+template <typename CorMatrix>
 void concaveCD(const double lambda,
                const unsigned int nn,
                SparseBlockMatrix& betas,
                CCDrAlgorithm& alg,
+               KKTCache* kkt,
+               GradientCache* grad,
+               EdgeLossCache* losses,
+               SigmaUpdater* sigmas,
+               CoordinateOrder* order,
                const PenaltyFunction& pen,
-               const std::vector<double>& cors,
+               const CorMatrix& cors,
                const int verbose
                ){
     #ifdef _DEBUG_ON_
@@ -601,24 +948,9 @@ void concaveCD(const double lambda,
 
     //
     // Compute sigmas
-    //   See Section 4.2.2. for the details of this calculation
+    //   See Section 4.2.2. for the details of this calculation (see SigmaUpdater.h)
     //
-    for(unsigned int j = 0; j < betas.dim(); ++j){
-        double c = 0;
-        for(unsigned int l = 0; l < betas.rowsizes(j); ++l){
-            unsigned int row = betas.row(j, l);
-
-            if(j <= row){
-                c += betas.value(j, l) * cors[(j + row*(row+1)/2)]; // c += beta_ij * <xj,xi>
-            }
-            else{
-                c += betas.value(j, l) * cors[(row + j*(j+1)/2)];   // c += beta_ij * <xj,xi> (also)
-            }
-        }
-
-        double s = 0.5 * (1.0 * c + sqrt(c * c + 4 * nn));
-        betas.setSigma(j, s);
-    } // end for loop for sigmas
+    updateSigmas(nn, betas, alg, kkt, sigmas, cors);
 
     #ifdef _DEBUG_ON_
         std::ostringstream sigma_out;
@@ -631,6 +963,50 @@ void concaveCD(const double lambda,
     #endif
 
     unsigned int pp = betas.dim();
+
+    //
+    // With alg.jacobi = true, the blocks are updated in conflict-free batches (see
+    //  EdgeColouring.h): all of the blocks in a batch have distinct nodes, so they can be updated concurrently.
+    //  The batches are handed out to the threads dynamically, so that threads that finish early pick up the
+    //  remaining blocks. The result depends on the colouring but not on the number of threads: with a single thread
+    //  the batches are updated in the same order.
+    //
+    #ifdef _OPENMP
+        int nthreads = (alg.nthreads <= 0) ? omp_get_max_threads() : alg.nthreads;
+    #endif
+
+    if(alg.jacobi){
+        EdgeColouring colouring(pp);
+        colouring.build(betas);
+
+        for(int c = 0; c < colouring.batches(); ++c){
+            long size = colouring.batchSize(c);
+
+            #ifdef _OPENMP
+            #pragma omp parallel for schedule(dynamic, 16) num_threads(nthreads) if(size >= _PARALLEL_CD_MIN_BLOCKS_)
+            #endif
+            for(long n = 0; n < size; ++n){
+                updateActiveBlock(colouring.column(c, n), colouring.index(c, n), lambda, nn, betas, kkt, grad, losses, sigmas, pen, cors, verbose);
+            }
+            alg.addUpdates(size);
+        }
+
+        return;
+    }
+
+    if(order != NULL && order->policy() != CoordinateOrder::CYCLIC){
+        order->build(betas);
+        for(std::size_t n = 0; n < order->size(); ++n){
+            int j = order->column(n), k = order->index(n);
+            double delta = updateActiveBlock(j, k, lambda, nn, betas, kkt, grad, losses, sigmas, pen, cors, verbose);
+            order->updated(j, k, delta);
+            alg.updateError(delta);
+        }
+        alg.addUpdates(order->size());
+
+        return;
+    }
+
     for(unsigned int j = 0; j < pp; ++j){
     	for(unsigned int rowIdx = 0; rowIdx < betas.rowsizes(j); ++rowIdx){
             unsigned int i = betas.row(j, rowIdx); // get the row from the sparse structure
@@ -643,25 +1019,8 @@ void concaveCD(const double lambda,
             //  so every edge does indeed end up getting updated
             if( j <= i) continue;
 
-            // get the current values in the block
-            double betakj = betas.value(j, rowIdx);
-            double betajk = betas.getSiblingValue(j, rowIdx);
-
-            // initialize the update values
-            double betaUpdateij = 0.0;
-            double betaUpdateji = 0.0;
-
-            // only update the nonzero edge
-            if(fabs(betakj) > ZERO_THRESH){
-                betaUpdateij = singleUpdate(i, j, lambda, nn, betas, pen, cors, verbose);
-            } else if(fabs(betajk) > ZERO_THRESH){
-                betaUpdateji = singleUpdate(j, i, lambda, nn, betas, pen, cors, verbose);
-            }
-
-            //
-            // Update the edge weights no matter what below -- if a block is "zeroed-out" this is ok
-            //
-            std::vector<double> err = betas.updateBlock(j, rowIdx, betaUpdateij, betaUpdateji);
+            updateActiveBlock(j, rowIdx, lambda, nn, betas, kkt, grad, losses, sigmas, pen, cors, verbose);
+            alg.addUpdates(1);
 
             #ifdef _DEBUG_ON_
                 if(betas.dim() <= 5){
@@ -677,6 +1036,186 @@ void concaveCD(const double lambda,
 
 }
 
+//
+// updateActiveBlock
+//
+//   Updates the nonzero edge in the block (row(j, k), j) of the active set; this is the inner loop of concaveCD.
+//
+//   Only columns i = row(j, k) and j of betas (and the entries of i and j in the caches) are read or written, so
+//     blocks that do not share a node can be updated concurrently (see EdgeColouring.h).
+//
+//   Output: The size of the update, |change in beta_ij| + |change in beta_ji|
+//
+template <typename CorMatrix>
+double updateActiveBlock(const unsigned int j,
+                         const unsigned int rowIdx,
+                         const double lambda,
+                         const unsigned int nn,
+                         SparseBlockMatrix& betas,
+                         KKTCache* kkt,
+                         GradientCache* grad,
+                         EdgeLossCache* losses,
+                         SigmaUpdater* sigmas,
+                         const PenaltyFunction& pen,
+                         const CorMatrix& cors,
+                         const int verbose
+                         ){
+    unsigned int i = betas.row(j, rowIdx);
+
+        // get the current values in the block
+        double betakj = betas.value(j, rowIdx);
+        double betajk = betas.getSiblingValue(j, rowIdx);
+
+        // initialize the update values
+        double betaUpdateij = 0.0;
+        double betaUpdateji = 0.0;
+
+        // only update the nonzero edge
+        if(fabs(betakj) > ZERO_THRESH){
+            if(grad != NULL){
+                betaUpdateij = pen.threshold(grad->residual(j, rowIdx, betas, cors), lambda);
+            } else{
+                betaUpdateij = singleUpdate(i, j, lambda, nn, betas, pen, cors, verbose);
+            }
+        } else if(fabs(betajk) > ZERO_THRESH){
+            if(grad != NULL){
+                betaUpdateji = pen.threshold(grad->residual(i, betas.block(j, rowIdx), betas, cors), lambda);
+            } else{
+                betaUpdateji = singleUpdate(j, i, lambda, nn, betas, pen, cors, verbose);
+            }
+        }
+
+        //
+        // Update the edge weights no matter what below -- if a block is "zeroed-out" this is ok
+        //
+        BlockDelta err = betas.updateBlock(j, rowIdx, betaUpdateij, betaUpdateji);
+        if(kkt != NULL){
+            kkt->columnChanged(j, err.ij);
+            kkt->columnChanged(i, err.ji);
+        }
+        if(grad != NULL){
+            grad->columnChanged(j, rowIdx, err.ij, betas, cors);
+            grad->columnChanged(i, betas.block(j, rowIdx), err.ji, betas, cors);
+        }
+        if(losses != NULL){
+            if(err.ij != 0) losses->columnChanged(j);
+            if(err.ji != 0) losses->columnChanged(i);
+        }
+        if(sigmas != NULL){
+            if(err.ij != 0) sigmas->columnChanged(j);
+            if(err.ji != 0) sigmas->columnChanged(i);
+        }
+
+    return fabs(err.ij) + fabs(err.ji);
+}
+
+//
+// updateSigmas
+//
+//   Recomputes the sigmas at the start of concaveCDInit and concaveCD. Only the columns of betas that have changed
+//     since the last call are recomputed, using alg.nthreads threads (see SigmaUpdater.h). If sigmas == NULL, every
+//     sigma is recomputed.
+//
+template <typename CorMatrix>
+void updateSigmas(const unsigned int nn,
+                  SparseBlockMatrix& betas,
+                  const CCDrAlgorithm& alg,
+                  KKTCache* kkt,
+                  SigmaUpdater* sigmas,
+                  const CorMatrix& cors
+                  ){
+    if(sigmas != NULL){
+        sigmas->update(nn, betas, kkt, cors, alg.nthreads);
+    } else{
+        SigmaUpdater all(betas.dim());
+        all.update(nn, betas, kkt, cors, alg.nthreads);
+    }
+}
+
+//
+// screenPairs
+//
+//   Computes the residual factors of every pair at the current estimate in order to (see PairScreen.h):
+//
+//     1) Check the KKT conditions of the pairs discarded by the screen: any pair whose single parameter update
+//         would be nonzero is added to the candidates
+//     2) Apply the strong rule for the next lambda in the grid (if any)
+//
+//   Only the discarded pairs are needed for 1), so if the strong rule is not applied to the next lambda, the residuals
+//     of the candidates and of the pairs with a block are not computed, and nothing is done at all if the screen did
+//     not discard any pairs.
+//
+//   Output: The number of KKT violations
+//
+template <typename CorMatrix>
+int screenPairs(const double lambda,
+                const SparseBlockMatrix& betas,
+                const CorMatrix& cors,
+                PairScreen& screen
+                ){
+    double next = screen.nextLambda();
+    double cutoff = 2 * next - lambda;
+    bool screenNext = (next >= 0 && cutoff > 0);
+    int violations = 0;
+
+    unsigned int pp = betas.dim();
+    screen.clearNext();
+    if(!screenNext && (!screen.active() || 2 * screen.candidates() == static_cast<std::size_t>(pp) * (pp - 1))) return 0;
+
+    for(unsigned int i = 0; i < pp; ++i){
+        for(unsigned int j = i + 1; j < pp; ++j){
+            // A zeroed-out block is not visited unless it is a candidate (see PairScreen::pairs)
+            bool discarded = screen.active() && !screen.isCandidate(i, j);
+            if(discarded){
+                int k = betas.find(i, j);
+                discarded = !(k >= 0 && (betas.value(j, k) != 0 || betas.getSiblingValue(j, k) != 0));
+            }
+            if(!discarded && !screenNext) continue;
+
+            double res = std::max(fabs(singleResidual(i, j, betas, cors)), fabs(singleResidual(j, i, betas, cors)));
+
+            // Both thresholding functions are zero iff |res| <= lambda
+            if(discarded && res > lambda){
+                screen.addCandidate(i, j);
+                violations++;
+            }
+
+            if(screenNext && res >= cutoff) screen.keepNext(i, j);
+        }
+    }
+
+    return violations;
+}
+
+//
+// singleResidual
+//
+//   Compute the residual factor res_ab used by the single parameter update for the edge between a -> b:
+//
+//     res_ab = \sum_h { x_hk * r_kj^(h) } = \rho_j*<xk,xj> - \sum_{i != k} \phi_ij <xi,xk>
+//
+//   Here, b = j = col, a = i = row.
+//
+template <typename CorMatrix>
+double singleResidual(const unsigned int a,
+                      const unsigned int b,
+                      const SparseBlockMatrix& betas,
+                      const CorMatrix& cors
+                      ){
+    // Get the value: \rho_j*<xk,xj>
+    double res_ab = betas.sigma(b) * cors.value(a, b);
+
+    // Subtract the terms \phi_ij <xi,xk>
+    for(unsigned int i = 0; i < betas.rowsizes(b); ++i){
+        unsigned int row = betas.row(b, i);
+        if(row != a){ // i=a is excluded
+            res_ab -= cors.value(row, a) * betas.value(b, i);
+        }
+    }
+
+    return res_ab;
+}
+
 //
 // singleUpdate
 //
@@ -690,14 +1229,16 @@ void concaveCD(const double lambda,
 //   NOTES:
 //     -See Sections 4.2.1 & 4.4 for a discussion of this calculation
 //
+template <typename CorMatrix>
 double singleUpdate(const unsigned int a,
                     const unsigned int b,
                     const double lambda,
                     const unsigned int nn,
                     const SparseBlockMatrix& betas,
                     const PenaltyFunction& pen,
-                    const std::vector<double>& cors,
-                    const int verbose
+                    const CorMatrix& cors,
+                    const int verbose,
+                    double* res
                     ){
 
     #ifdef _DEBUG_ON_
@@ -708,31 +1249,10 @@ double singleUpdate(const unsigned int a,
     double betaUpdate = 0; // initialize eventual return value
 
     //
-    // res_ab = the value of the residual factor from the paper, given by
-    //    \sum_h { x_hk * r_kj^(h) } = \rho_j*<xk,xj> - \sum_{i != k} \phi_ij <xi,xk>
+    // res_ab = the value of the residual factor from the paper (see singleResidual)
     //
-    // Here, b = j = col, a = i = row.
-    //
-    double res_ab = 0;
-
-    // Get the value: \rho_j*<xk,xj>
-    if(a <= b){
-        res_ab = betas.sigma(b) * cors[(a + b*(b+1)/2)];
-    }
-    else{
-        res_ab = betas.sigma(b) * cors[(b + a*(a+1)/2)];
-    }
-
-    // Subtract the terms \phi_ij <xi,xk>
-    for(unsigned int i = 0; i < betas.rowsizes(b); ++i){
-        unsigned int row = betas.row(b, i);
-        if(row < a){
-            res_ab -= cors[(row + a*(a+1)/2)] * betas.value(b, i);
-        }
-        else if(row > a){ // i=a is excluded
-            res_ab -= cors[(a + row*(row+1)/2)] * betas.value(b, i);
-        }
-    }
+    double res_ab = singleResidual(a, b, betas, cors);
+    if(res != NULL) *res = res_ab;
 
     //
     // The SPU is given by S_gamma(res_ab, lambda), aka evaluating the threshold function
@@ -751,6 +1271,12 @@ double singleUpdate(const unsigned int a,
 //
 // computeEdgeLoss
 //
+//   Computes the penalized loss of column b with beta_ab = 0 (S[0]) and with beta_ab = betaUpdate (S[1]).
+//
+//   If losses != NULL, S[0] is computed from the cached terms of column b in O(rowsizes(b)) instead of
+//     O(rowsizes(b)^2) (see EdgeLossCache.h).
+//
+template <typename CorMatrix>
 void computeEdgeLoss(const double betaUpdate,
                      const unsigned int a,
                      const unsigned int b,
@@ -758,9 +1284,10 @@ void computeEdgeLoss(const double betaUpdate,
                      const unsigned int nn,
                      SparseBlockMatrix& betas,
                      const PenaltyFunction& pen,
-                     const std::vector<double>& cors,
+                     const CorMatrix& cors,
                      double S[],
-                     const int verbose){
+                     const int verbose,
+                     EdgeLossCache* losses){
     //
     // Now that we have computed the value of the SPU, we need to calculate its contribution
     //   to the penalized likelihood function
@@ -772,6 +1299,9 @@ void computeEdgeLoss(const double betaUpdate,
     double loss = 0, penalty = 0;
     int oldIdx_ab = betas.find(a, b); // determine whether or not the edge a->b is already in the model
 
+    // The cached terms are those of the full column b, so they must be refreshed before beta_ab is zeroed out below
+    if(losses != NULL) losses->refresh(b, betas, pen, cors);
+
     // If the edge a->b is in the model, grab its value, otherwise set it to zero
     //   This variable is used later to restore betas to its original state
     double oldBeta_ab = (oldIdx_ab >= 0) ? betas.value(b, oldIdx_ab) : 0; // 7/31/14: used to be oldIdx_ab > 0; pretty sure this was a bug since this value can be zero and still valid
@@ -789,32 +1319,49 @@ void computeEdgeLoss(const double betaUpdate,
     FILE_LOG(logDEBUG3) << oldBeta_ab << " / " << oldBeta_ba;
 #endif
 
-    // Compute the value of the loss
-    loss = betas.sigma(b) * betas.sigma(b);
-    for(unsigned int m = 0; m < betas.rowsizes(b); ++m){
-        unsigned int row_m = betas.row(b, m);
+    if(losses != NULL){
+        //
+        // Remove the contribution of beta_ab from the cached terms of column b (see EdgeLossCache.h): With g = the
+        //   sum of <xa,xm> * beta_mb over m != a,
+        //
+        //   quadratic(b) = (quadratic form with beta_ab = 0) + 2 * beta_ab * g + <xa,xa> * beta_ab^2
+        //
+        double quad = losses->quadratic(b);
+        double lin = losses->linear(b);
+        penalty = losses->penalty(b);
+
+        if(oldBeta_ab != 0){
+            double g = 0;
+            for(unsigned int m = 0; m < betas.rowsizes(b); ++m){
+                g += cors.value(a, betas.row(b, m)) * betas.value(b, m); // beta_ab has been zeroed out above
+            }
+
+            quad -= oldBeta_ab * (2.0 * g + cors.value(a, a) * oldBeta_ab);
+            lin -= cors.value(a, b) * oldBeta_ab;
+            penalty += pen.p(0.0, lambda) - pen.p(fabs(oldBeta_ab), lambda);
+        }
 
-        for(unsigned int n = 0; n < betas.rowsizes(b); ++n){
-            unsigned int row_n = betas.row(b, n);
+        loss = betas.sigma(b) * betas.sigma(b) + quad - 2.0 * betas.sigma(b) * lin;
+    } else{
+        // Compute the value of the loss
+        loss = betas.sigma(b) * betas.sigma(b);
+        for(unsigned int m = 0; m < betas.rowsizes(b); ++m){
+            unsigned int row_m = betas.row(b, m);
 
-            if(row_m <= row_n){
-                loss += cors[(row_m + row_n*(row_n+1)/2)] * betas.value(b, m) * betas.value(b, n);
-            } else{
-                loss += cors[(row_n + row_m*(row_m+1)/2)] * betas.value(b, m) * betas.value(b, n);
+            for(unsigned int n = 0; n < betas.rowsizes(b); ++n){
+                unsigned int row_n = betas.row(b, n);
+
+                loss += cors.value(row_m, row_n) * betas.value(b, m) * betas.value(b, n);
             }
-        }
 
-        if(row_m <= b){
-            loss -= 2.0 * betas.sigma(b) * cors[(row_m + b*(b+1)/2)] * betas.value(b, m);
-        } else{
-            loss -= 2.0 * betas.sigma(b) * cors[(b + row_m*(row_m+1)/2)] * betas.value(b, m);
+            loss -= 2.0 * betas.sigma(b) * cors.value(row_m, b) * betas.value(b, m);
         }
-    }
 
-    // Compute the value of the penalty
-    penalty = 0;
-    for(unsigned int i = 0; i < betas.rowsizes(b); ++i){
-        penalty += pen.p(fabs(betas.value(b, i)), lambda);
+        // Compute the value of the penalty
+        penalty = 0;
+        for(unsigned int i = 0; i < betas.rowsizes(b); ++i){
+            penalty += pen.p(fabs(betas.value(b, i)), lambda);
+        }
     }
     //penalty -= pen.p(fabs(betas[(pp * b) + b]), lambda); // ignore contribution from beta_bb (should be zero anyway!!!)
 
@@ -839,20 +1386,15 @@ void computeEdgeLoss(const double betaUpdate,
             unsigned int row = betas.row(b, i);
 
             if(row < a){
-                S[1] += 2.0 * cors[(row + a*(a+1)/2)] * betas.value(b, i) * betaUpdate;
+                S[1] += 2.0 * cors.value(row, a) * betas.value(b, i) * betaUpdate;
             }
-            else if(i > a){ // case when i = a is handled separately below
-                S[1] += 2.0 * cors[(a + row*(row+1)/2)] * betas.value(b, i) * betaUpdate;
+            else if(row > a){ // case when row = a is handled separately below
+                S[1] += 2.0 * cors.value(a, row) * betas.value(b, i) * betaUpdate;
             }
         }
-        S[1] += cors[(a + a*(a+1)/2)] * betaUpdate * betaUpdate;
+        S[1] += cors.value(a, a) * betaUpdate * betaUpdate;
 
-        if(a <= b){
-            S[1] -= 2.0 * betas.sigma(b) * cors[(a + b*(b+1)/2)] * betaUpdate;
-        }
-        else{
-            S[1] -= 2.0 * betas.sigma(b) * cors[(b + a*(a+1)/2)] * betaUpdate;
-        }
+        S[1] -= 2.0 * betas.sigma(b) * cors.value(a, b) * betaUpdate;
 
         // Of course the penalty decomposes like the loss as well, so we can just add
         //   the contribution of pen(beta_ab)
@@ -873,18 +1415,20 @@ void computeEdgeLoss(const double betaUpdate,
 //
 //   Output: 0 = no cycle induced, 1 = cycle is induced
 //
-//   UPDATE 05/14/14: Arrays are indeed faster than vectors, but we do not know the size of the arrays at compile time.
-//                     This is a big issue; moreover, the old code did not properly initialize these arrays which is
-//                     forbidden anyway when the size is not known at compile time. For now, we have reverted back to
-//                     using vectors, but this should be revisited in the future.
+//   UPDATE 05/02/16: The search now lives in CycleChecker, which owns the scratch space for the search. The old
+//                     code zero-initialized two arrays of _MAX_CCS_ARRAY_SIZE_ ints on every call (and so capped
+//                     the number of nodes); the scratch space is now allocated once per call to singleCCDr and
+//                     sized to betas.dim().
+//
+//   UPDATE 05/03/16: CycleChecker also maintains a topological order of betas, so that most edges are accepted
+//                     without any search at all (see CycleChecker.h). concaveCDInit keeps the order up to date.
+//
+//   UPDATE 05/04/16: The remaining queries are answered from a cache of ancestor bitsets wherever possible.
 //
 //   NOTES:
 //     -see Fei's paper for original source for algorithm and his original code for the original implementation
-//     -the vectors that have been commented out have been left as a reminder to use ARRAYS in this function instead
-//       of vectors: the allocation cost of vectors turns out to be highly nontrivial and costly here and MUST be
-//       avoided
 //
-bool checkCycleSparse(const int node,
+bool checkCycleSparse(CycleChecker& ccs,
                       const SparseBlockMatrix& betas,
                       int a,
                       int b
@@ -895,46 +1439,7 @@ bool checkCycleSparse(const int node,
         ccs_calls++;
     #endif
 
-    a++; b++; // modification to adjust for re-indexing from zero
-
-    if(a==b)  return true;
-
-    int i, j, k, lo, nBot = 0, nTop = 0, SLeng = 1;
-    bool bCycle = false;
-
-//    std::vector<int> color(node, 0);
-//    std::vector<int> S(node, 0);
-    int color[_MAX_CCS_ARRAY_SIZE_] = {};
-    int S[_MAX_CCS_ARRAY_SIZE_] = {};
-    color[a-1] = 1;
-    S[0] = a;
-
-    while(SLeng > 0){
-
-        i = S[nBot] - 1;
-        SLeng--;
-        nBot++;
-
-        for(k = 0; k < betas.rowsizes(i); ++k){
-            j = betas.row(i, k);
-
-            if(fabs(betas.value(i, k)) > ZERO_THRESH){
-                if((j+1) == b){
-                    bCycle = true;
-                    break;
-                } else if(color[j]==0){
-                    nTop++;
-                    S[nTop] = j + 1;
-                    SLeng++;
-                    color[j] = 1;
-                }
-            }
-        }
-
-        if(bCycle) break;
-    }
-
-    return bCycle;
+    return ccs.hasCycle(betas, a, b);
 }
 
 #endif
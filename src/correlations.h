@@ -0,0 +1,472 @@
+//
+//  correlations.h
+//  ccdr_proj
+//
+
+#ifndef correlations_h
+#define correlations_h
+
+#include <vector>
+#include <limits>
+#include <algorithm>
+#include <math.h>
+
+#include "defines.h"
+
+//------------------------------------------------------------------------------/
+//   PACKED CORRELATION BUILDER
+//------------------------------------------------------------------------------/
+
+//
+// Computes the packed vector of correlations that is consumed by gridCCDr / singleCCDr directly from the data
+//   matrix, without ever forming the full pp x pp correlation matrix (which is what cor() does in R).
+//
+// The output uses the same layout as cors[upper.tri(cors, diag = TRUE)] in R, i.e. the correlation between
+//   columns a <= b is stored at position a + b*(b+1)/2.
+//
+// The computation proceeds in two stages:
+//
+//   1) Each column is centred and scaled to unit norm, so that <z_a, z_b> = cor(x_a, x_b).
+//   2) The upper triangle of the Gram matrix Z'Z is split into square tiles of _CORS_TILE_SIZE_ columns. Each
+//       tile is accumulated over chunks of _CORS_ROW_CHUNK_ rows (so that both column panels stay in cache) and
+//       then scattered into the packed vector. Tiles are independent, so they are distributed across threads.
+//
+// Zero-variance columns produce NaN (converted to NA by R) in the same way as cor().
+//
+
+//
+// standardizeColumns
+//
+//   Copies the nn x pp (column-major) matrix X into Z with each column centred and scaled to unit L2 norm.
+//
+//   Output: A vector whose jth entry is 1 if column j has zero variance (and hence cannot be scaled), 0 otherwise
+//
+std::vector<int> standardizeColumns(const double* X,
+                                    const std::size_t nn,
+                                    const std::size_t pp,
+                                    std::vector<double>& Z){
+    Z.resize(nn * pp);
+    std::vector<int> zeroVariance(pp, 0);
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(static)
+    #endif
+    for(long jj = 0; jj < static_cast<long>(pp); ++jj){
+        std::size_t j = static_cast<std::size_t>(jj);
+        const double* x = X + j * nn;
+        double* z = &Z[0] + j * nn;
+
+        // Two-pass mean and sum of squares for numerical stability (same as cor())
+        double mean = 0;
+        for(std::size_t r = 0; r < nn; ++r) mean += x[r];
+        mean /= static_cast<double>(nn);
+
+        double ss = 0;
+        for(std::size_t r = 0; r < nn; ++r){
+            z[r] = x[r] - mean;
+            ss += z[r] * z[r];
+        }
+
+        if(ss > 0){
+            double scale = 1.0 / sqrt(ss);
+            for(std::size_t r = 0; r < nn; ++r) z[r] *= scale;
+        } else{
+            zeroVariance[j] = 1;
+        }
+    }
+
+    return zeroVariance;
+}
+
+//
+// dotProduct
+//
+//   Inner product of two contiguous vectors of length n. Four independent accumulators are used so that the
+//   compiler can keep the FP pipeline (and SIMD lanes, when vectorized) busy.
+//
+inline double dotProduct(const double* x, const double* y, const std::size_t n){
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    std::size_t r = 0;
+    for(; r + 4 <= n; r += 4){
+        s0 += x[r] * y[r];
+        s1 += x[r + 1] * y[r + 1];
+        s2 += x[r + 2] * y[r + 2];
+        s3 += x[r + 3] * y[r + 3];
+    }
+    for(; r < n; ++r) s0 += x[r] * y[r];
+
+    return (s0 + s1) + (s2 + s3);
+}
+
+//
+// gramTile
+//
+//   Accumulates the (aStart:aEnd) x (bStart:bEnd) tile of Z'Z into tile (leading dimension _CORS_TILE_SIZE_). On a
+//   diagonal tile only the entries with a <= b are computed.
+//
+void gramTile(const std::vector<double>& Z,
+              const std::size_t nn,
+              const std::size_t aStart, const std::size_t aEnd,
+              const std::size_t bStart, const std::size_t bEnd,
+              std::vector<double>& tile){
+    const std::size_t T = _CORS_TILE_SIZE_;
+    bool diagonalTile = (aStart == bStart);
+
+    std::fill(tile.begin(), tile.end(), 0.0);
+
+    // Accumulate the tile over chunks of rows so the two column panels remain cache-resident
+    for(std::size_t r0 = 0; r0 < nn; r0 += _CORS_ROW_CHUNK_){
+        std::size_t len = std::min(static_cast<std::size_t>(_CORS_ROW_CHUNK_), nn - r0);
+
+        for(std::size_t b = bStart; b < bEnd; ++b){
+            const double* zb = &Z[0] + b * nn + r0;
+            std::size_t aLast = diagonalTile ? b : aEnd - 1; // only need a <= b on diagonal tiles
+
+            for(std::size_t a = aStart; a <= aLast; ++a){
+                const double* za = &Z[0] + a * nn + r0;
+                tile[(a - aStart) + (b - bStart) * T] += dotProduct(za, zb, len);
+            }
+        }
+    }
+}
+
+//
+// tileCorrelation
+//
+//   Converts the raw inner product <z_a, z_b> from gramTile into the value reported by cor()
+//
+inline double tileCorrelation(const std::vector<double>& tile,
+                              const std::vector<int>& zeroVariance,
+                              const std::size_t a, const std::size_t aStart,
+                              const std::size_t b, const std::size_t bStart){
+    if(zeroVariance[a] || zeroVariance[b]){
+        return std::numeric_limits<double>::quiet_NaN();
+    } else if(a == b){
+        return 1.0;
+    }
+
+    double c = tile[(a - aStart) + (b - bStart) * _CORS_TILE_SIZE_];
+    if(c > 1.0) c = 1.0;    // guard against rounding error, as in cor()
+    if(c < -1.0) c = -1.0;
+
+    return c;
+}
+
+//
+// upperTiles
+//
+//   Enumerates the tiles (I, J) with I <= J in the upper triangle of a pp x pp matrix, so that they can be
+//   scheduled as a flat (parallel) loop
+//
+void upperTiles(const std::size_t pp, std::vector<std::size_t>& tileI, std::vector<std::size_t>& tileJ){
+    const std::size_t numTiles = (pp + _CORS_TILE_SIZE_ - 1) / _CORS_TILE_SIZE_;
+
+    tileI.clear();
+    tileJ.clear();
+    for(std::size_t J = 0; J < numTiles; ++J){
+        for(std::size_t I = 0; I <= J; ++I){
+            tileI.push_back(I);
+            tileJ.push_back(J);
+        }
+    }
+}
+
+//
+// packedCorrelations
+//
+//   Input:
+//      X = pointer to an nn x pp data matrix stored in column-major order
+//      cors = pointer to an array of length pp*(pp+1)/2, which is overwritten with the packed correlations
+//      nthreads = number of threads to use; if <= 0, use all available cores
+//   Output: void
+//
+void packedCorrelations(const double* X,
+                        const std::size_t nn,
+                        const std::size_t pp,
+                        double* cors,
+                        int nthreads = 0){
+    std::vector<double> Z;
+    std::vector<int> zeroVariance = standardizeColumns(X, nn, pp, Z);
+
+    const std::size_t T = _CORS_TILE_SIZE_;
+    std::vector<std::size_t> tileI, tileJ;
+    upperTiles(pp, tileI, tileJ);
+
+    #ifdef _OPENMP
+        if(nthreads <= 0) nthreads = omp_get_max_threads();
+    #endif
+
+    #ifdef _OPENMP
+    #pragma omp parallel num_threads(nthreads)
+    #endif
+    {
+        std::vector<double> tile(T * T); // per-thread accumulator for a single tile
+
+        #ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+        #endif
+        for(long t = 0; t < static_cast<long>(tileI.size()); ++t){
+            std::size_t aStart = tileI[t] * T, aEnd = std::min(aStart + T, pp);
+            std::size_t bStart = tileJ[t] * T, bEnd = std::min(bStart + T, pp);
+            bool diagonalTile = (tileI[t] == tileJ[t]);
+
+            gramTile(Z, nn, aStart, aEnd, bStart, bEnd, tile);
+
+            // Scatter the tile into the packed vector
+            for(std::size_t b = bStart; b < bEnd; ++b){
+                std::size_t aLast = diagonalTile ? b : aEnd - 1;
+                double* col = cors + b * (b + 1) / 2;
+
+                for(std::size_t a = aStart; a <= aLast; ++a){
+                    col[a] = tileCorrelation(tile, zeroVariance, a, aStart, b, bStart);
+                }
+            }
+        }
+    }
+}
+
+//------------------------------------------------------------------------------/
+//   INCREMENTAL SUFFICIENT STATISTICS
+//------------------------------------------------------------------------------/
+
+//
+// When new samples are appended to the data, the correlations can be refreshed without revisiting the old rows by
+//   keeping the column means and the packed co-moment matrix
+//
+//      M = sum_r (x_r - mean)(x_r - mean)'     (same layout as the packed correlations)
+//
+//   over the nn rows seen so far. Given a batch of k new rows with means m_new and co-moment matrix M_new (a rank-k
+//   update, computed with the same tiled Gram kernel as above), the pooled statistics are
+//
+//      d = m_new - mean
+//      M <- M + M_new + (nn * k / (nn + k)) * d d'
+//      mean <- mean + (k / (nn + k)) * d
+//
+//   This is the batched form of Welford's update, which avoids the cancellation error of accumulating raw sums
+//   and cross-products. The correlations are then M_ab / sqrt(M_aa * M_bb).
+//
+
+//
+// updateComoments
+//
+//   Input:
+//      X = pointer to a k x pp matrix of new rows, stored in column-major order
+//      nn = number of rows already summarized by means / comoments (may be zero)
+//      means = pointer to an array of length pp, updated in place
+//      comoments = pointer to an array of length pp*(pp+1)/2, updated in place
+//      nthreads = number of threads to use; if <= 0, use all available cores
+//   Output: void
+//
+void updateComoments(const double* X,
+                     const std::size_t k,
+                     const std::size_t pp,
+                     const std::size_t nn,
+                     double* means,
+                     double* comoments,
+                     int nthreads = 0){
+    if(k == 0) return;
+
+    // Centre the new rows around their own means
+    std::vector<double> Z(k * pp), d(pp);
+    for(std::size_t j = 0; j < pp; ++j){
+        const double* x = X + j * k;
+        double* z = &Z[0] + j * k;
+
+        double mean = 0;
+        for(std::size_t r = 0; r < k; ++r) mean += x[r];
+        mean /= static_cast<double>(k);
+
+        for(std::size_t r = 0; r < k; ++r) z[r] = x[r] - mean;
+        d[j] = mean - means[j];
+    }
+
+    const double total = static_cast<double>(nn + k);
+    const double coef = static_cast<double>(nn) * static_cast<double>(k) / total;
+
+    const std::size_t T = _CORS_TILE_SIZE_;
+    std::vector<std::size_t> tileI, tileJ;
+    upperTiles(pp, tileI, tileJ);
+
+    #ifdef _OPENMP
+        if(nthreads <= 0) nthreads = omp_get_max_threads();
+    #endif
+
+    #ifdef _OPENMP
+    #pragma omp parallel num_threads(nthreads)
+    #endif
+    {
+        std::vector<double> tile(T * T);
+
+        #ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+        #endif
+        for(long t = 0; t < static_cast<long>(tileI.size()); ++t){
+            std::size_t aStart = tileI[t] * T, aEnd = std::min(aStart + T, pp);
+            std::size_t bStart = tileJ[t] * T, bEnd = std::min(bStart + T, pp);
+            bool diagonalTile = (tileI[t] == tileJ[t]);
+
+            gramTile(Z, k, aStart, aEnd, bStart, bEnd, tile);
+
+            for(std::size_t b = bStart; b < bEnd; ++b){
+                std::size_t aLast = diagonalTile ? b : aEnd - 1;
+                double* col = comoments + b * (b + 1) / 2;
+
+                for(std::size_t a = aStart; a <= aLast; ++a){
+                    col[a] += tile[(a - aStart) + (b - bStart) * T] + coef * d[a] * d[b];
+                }
+            }
+        }
+    }
+
+    for(std::size_t j = 0; j < pp; ++j){
+        means[j] += d[j] * static_cast<double>(k) / total;
+    }
+}
+
+//
+// comomentCorrelations
+//
+//   Converts the packed co-moment matrix from updateComoments into the packed correlations (overwriting cors).
+//   Zero-variance columns produce NaN, as in packedCorrelations.
+//
+void comomentCorrelations(const double* comoments,
+                          const std::size_t pp,
+                          double* cors){
+    std::vector<double> scale(pp);
+    for(std::size_t j = 0; j < pp; ++j){
+        double v = comoments[j + j * (j + 1) / 2];
+        scale[j] = (v > 0) ? 1.0 / sqrt(v) : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    #ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic)
+    #endif
+    for(long bb = 0; bb < static_cast<long>(pp); ++bb){
+        std::size_t b = static_cast<std::size_t>(bb);
+        const double* m = comoments + b * (b + 1) / 2;
+        double* col = cors + b * (b + 1) / 2;
+
+        for(std::size_t a = 0; a < b; ++a){
+            double c = m[a] * scale[a] * scale[b];
+            if(c > 1.0) c = 1.0;    // guard against rounding error, as in cor()
+            if(c < -1.0) c = -1.0;
+            col[a] = c;
+        }
+        col[b] = (m[b] > 0) ? 1.0 : std::numeric_limits<double>::quiet_NaN();
+    }
+}
+
+//------------------------------------------------------------------------------/
+//   SPARSE (CSC) CORRELATIONS
+//------------------------------------------------------------------------------/
+
+//
+// Correlations of a sparse nn x pp matrix stored in compressed sparse column (CSC) form, i.e. the layout used by
+//   Matrix::dgCMatrix in R: the nonzero values of column j are vals[colPtr[j]], ..., vals[colPtr[j+1] - 1] and
+//   their rows are given by rowIdx. Centring the columns would destroy the sparsity, so instead we use
+//
+//      sum_r (x_ra - m_a)(x_rb - m_b) = x_a'x_b - nn * m_a * m_b
+//
+//   where x_a'x_b only involves the nonzeros. To find the pairs of columns that share a nonzero row without
+//   comparing every pair of columns, the matrix is first transposed into compressed sparse row (CSR) form. Then for
+//   each column b, every nonzero x_rb is multiplied against the nonzeros of row r (with column a <= b) and
+//   accumulated into a dense vector of length pp. The work is therefore sum_r nnz(row r)^2 instead of nn * pp^2,
+//   plus the pp*(pp+1)/2 outputs themselves.
+//
+// Columns are processed in blocks of _CORS_TILE_SIZE_, which are distributed across threads (later columns have
+//   more outputs, hence the dynamic schedule). Each thread has its own accumulator.
+//
+
+//
+// packedCorrelations (sparse)
+//
+//   Input:
+//      colPtr, rowIdx, vals = CSC representation of an nn x pp matrix (rows sorted within each column)
+//      cors = pointer to an array of length pp*(pp+1)/2, which is overwritten with the packed correlations
+//      nthreads = number of threads to use; if <= 0, use all available cores
+//   Output: void
+//
+void packedCorrelations(const int* colPtr,
+                        const int* rowIdx,
+                        const double* vals,
+                        const std::size_t nn,
+                        const std::size_t pp,
+                        double* cors,
+                        int nthreads = 0){
+    const std::size_t nnz = (pp > 0) ? static_cast<std::size_t>(colPtr[pp]) : 0;
+
+    // Column means and (two-pass) centred sums of squares; the zeros contribute (nn - nnz_j) * m_j^2
+    std::vector<double> means(pp), scale(pp);
+    for(std::size_t j = 0; j < pp; ++j){
+        double mean = 0;
+        for(int k = colPtr[j]; k < colPtr[j + 1]; ++k) mean += vals[k];
+        mean /= static_cast<double>(nn);
+
+        double ss = static_cast<double>(nn - (colPtr[j + 1] - colPtr[j])) * mean * mean;
+        for(int k = colPtr[j]; k < colPtr[j + 1]; ++k) ss += (vals[k] - mean) * (vals[k] - mean);
+
+        means[j] = mean;
+        scale[j] = (ss > 0) ? 1.0 / sqrt(ss) : std::numeric_limits<double>::quiet_NaN();
+    }
+
+    // Transpose into CSR; since the columns are visited in order, the columns within each row come out sorted
+    std::vector<std::size_t> rowPtr(nn + 1, 0);
+    for(std::size_t k = 0; k < nnz; ++k) ++rowPtr[rowIdx[k] + 1];
+    for(std::size_t r = 0; r < nn; ++r) rowPtr[r + 1] += rowPtr[r];
+
+    std::vector<int> csrCol(nnz);
+    std::vector<double> csrVal(nnz);
+    std::vector<std::size_t> next(rowPtr.begin(), rowPtr.end() - 1);
+    for(std::size_t j = 0; j < pp; ++j){
+        for(int k = colPtr[j]; k < colPtr[j + 1]; ++k){
+            std::size_t pos = next[rowIdx[k]]++;
+            csrCol[pos] = static_cast<int>(j);
+            csrVal[pos] = vals[k];
+        }
+    }
+
+    const std::size_t T = _CORS_TILE_SIZE_;
+    const std::size_t numBlocks = (pp + T - 1) / T;
+
+    #ifdef _OPENMP
+        if(nthreads <= 0) nthreads = omp_get_max_threads();
+    #endif
+
+    #ifdef _OPENMP
+    #pragma omp parallel num_threads(nthreads)
+    #endif
+    {
+        std::vector<double> acc(pp, 0.0); // per-thread accumulator for x_a'x_b, a <= b
+
+        #ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+        #endif
+        for(long blk = 0; blk < static_cast<long>(numBlocks); ++blk){
+            std::size_t bEnd = std::min((blk + 1) * T, pp);
+
+            for(std::size_t b = blk * T; b < bEnd; ++b){
+                for(int k = colPtr[b]; k < colPtr[b + 1]; ++k){
+                    std::size_t r = rowIdx[k];
+                    double xb = vals[k];
+
+                    for(std::size_t q = rowPtr[r]; q < rowPtr[r + 1] && static_cast<std::size_t>(csrCol[q]) <= b; ++q){
+                        acc[csrCol[q]] += csrVal[q] * xb;
+                    }
+                }
+
+                double* col = cors + b * (b + 1) / 2;
+                for(std::size_t a = 0; a < b; ++a){
+                    double c = (acc[a] - static_cast<double>(nn) * means[a] * means[b]) * scale[a] * scale[b];
+                    if(c > 1.0) c = 1.0;    // guard against rounding error, as in cor()
+                    if(c < -1.0) c = -1.0;
+                    col[a] = c;
+                    acc[a] = 0;
+                }
+                col[b] = (scale[b] > 0) ? 1.0 : std::numeric_limits<double>::quiet_NaN(); // scale is NaN for zero variance
+                acc[b] = 0;
+            }
+        }
+    }
+}
+
+#endif
@@ -20,29 +20,94 @@
 //   directive and defines are restricted to this file. In addition, any includes that
 //   depend on one of these directives are included here.
 //
-// The three main defines are:
+// The two main defines are:
 //
-//    1) _MAX_CCS_ARRAY_SIZE_ : This implicitly defines an upper limit on the size of the
-//                              graphs that this program will estimate (see checkCycleSparse
-//                              for details). Feel free to increase this value, however,
-//                              note that this code has only been tested up 8000 nodes.
-//
-//    2) _DEBUG_ON_ : When defined, debugging code is activated and the log file is
+//    1) _DEBUG_ON_ : When defined, debugging code is activated and the log file is
 //                    written to.
 //
-//    3) _COMPILE_FOR_RCPP_ : When defined, the assumption is that Rcpp is compiling
+//    2) _COMPILE_FOR_RCPP_ : When defined, the assumption is that Rcpp is compiling
 //                            the code through R. As a result, the log file is completely
 //                            disabled, output is redirected to R, and the Rcpp.h header
 //                            is loaded.
 //
+// In addition, the tile sizes used by the correlation builder (see correlations.h) are set here:
+//
+//    _CORS_TILE_SIZE_ : Number of columns in each square tile of the Gram matrix.
+//    _CORS_ROW_CHUNK_ : Number of rows of each column panel that are processed at a time; together
+//                       with _CORS_TILE_SIZE_ this should keep two panels inside the L2 cache.
+//
+// _LAZY_CORS_CACHE_TILES_ is the default number of tiles kept in the cache of LazyCorrelationMatrix (each tile
+//   holds _CORS_TILE_SIZE_^2 doubles, so the default of 4096 tiles is 128MB).
+//
+// _STREAM_CHUNK_ROWS_ is the number of rows read at a time by the streaming data readers (see DataStream.h).
+//
+// _CYCLE_CACHE_MB_ is the largest amount of memory (in MB) used by the reachability cache of CycleChecker. The cache
+//   takes pp^2 / 8 bytes, so the default of 256MB covers graphs with up to ~46k nodes.
+//
+// _KKT_CACHE_MB_ is the largest amount of memory (in MB) used by the certificates of KKTCache (4 * pp^2 bytes, so the
+//   default of 128MB covers graphs with up to ~5.8k nodes). gridCCDr keeps one cache for the whole grid, but each
+//   call to singleCCDr (i.e. each lambda of ccdr_gridR) allocates its own.
+//
+// _GRADIENT_CACHE_MB_ is the largest amount of memory (in MB) used by the partial products of GradientCache (one double
+//   per sparse row of betas); set it to zero to disable the cache.
+//
+// Similarly, _PSM_TILE_SIZE_ sets the tile size for the TILED layout of PackedSymmetricMatrix. This
+//   should be a power of two so that the index arithmetic compiles down to shifts and masks.
+//
+// _PARALLEL_SWEEP_MIN_PAIRS_ is the smallest number of pairs in a row of concaveCDInit for which the proposals are
+//   computed in parallel; shorter rows are not worth the overhead of starting the threads. Likewise,
+//   _PARALLEL_CD_MIN_BLOCKS_ is the smallest batch of blocks that concaveCD updates in parallel, and
+//   _PARALLEL_SIGMA_MIN_COLUMNS_ is the smallest number of stale sigmas that are recomputed in parallel.
+//
+// _SIGMA_CHUNK_ is the number of correlations that SigmaUpdater gathers at a time for the vectorized sums (a multiple
+//   of four).
+//
+// _SBM_INDEX_MIN_ROWS_ is the largest number of rows in a column of SparseBlockMatrix that is searched by a linear
+//   scan; columns with more rows are found through the edge index (see SparseBlockMatrix.h).
+//
+// When _SBM_ARENA_ is defined, SparseBlockMatrix stores all of its columns in one flat arena instead of a vector per
+//   column, with _SBM_ARENA_SLACK_ free rows at the end of each column (see SparseBlockMatrix.h). Compiling with
+//   -D_SBM_VECTORS_ selects the old layout with one vector per column instead.
+//
+// _SBM_MAX_DEAD_FRACTION_ is the largest fraction of zeroed-out blocks that singleCCDr tolerates in a column of betas
+//   before the matrix is compacted (see SparseBlockMatrix::compact).
+//
+// Compiling with -D_CCDR_STANDALONE_ undefines _COMPILE_FOR_RCPP_, so that the headers can be used outside of R
+//   (e.g. by the benchmarks in benchmarks/).
+//
+// OpenMP is used for multithreading whenever the compiler supports it (see Makevars); when it
+//   does not, _OPENMP is undefined and all of the parallel code falls back to a single thread.
+//
 
-#define _MAX_CCS_ARRAY_SIZE_ 5000
+#define _CORS_TILE_SIZE_ 64
+#define _CORS_ROW_CHUNK_ 256
+#define _PSM_TILE_SIZE_ 32
+#define _LAZY_CORS_CACHE_TILES_ 4096
+#define _STREAM_CHUNK_ROWS_ 1024
+#define _CYCLE_CACHE_MB_ 256
+#define _KKT_CACHE_MB_ 128
+#define _GRADIENT_CACHE_MB_ 256
+#define _PARALLEL_SWEEP_MIN_PAIRS_ 256
+#define _PARALLEL_CD_MIN_BLOCKS_ 64
+#define _PARALLEL_SIGMA_MIN_COLUMNS_ 256
+#define _SIGMA_CHUNK_ 64
+#define _SBM_INDEX_MIN_ROWS_ 16
+#define _SBM_ARENA_SLACK_ 4
+#define _SBM_MAX_DEAD_FRACTION_ 0.25
+
+#define _SBM_ARENA_
+#ifdef _SBM_VECTORS_
+    #undef _SBM_ARENA_
+#endif
 
 #define _DEBUG_ON_
 #undef _DEBUG_ON_
 
 #define _COMPILE_FOR_RCPP_
 //#undef _COMPILE_FOR_RCPP_
+#ifdef _CCDR_STANDALONE_
+    #undef _COMPILE_FOR_RCPP_
+#endif
 
 #ifdef _DEBUG_ON_
     #include <string>
@@ -53,6 +118,10 @@
     #include "log.h" // logging moved here since it only runs in debug mode anyway
 #endif
 
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
 // Include the Rcpp header and redirect output to R if we are compiling using Rcpp
 #ifdef _COMPILE_FOR_RCPP_
     #include <Rcpp.h>
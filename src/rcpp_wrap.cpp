@@ -15,6 +15,10 @@
 
 #include <Rcpp.h>
 #include "algorithm.h"
+#include "correlations.h"
+#include "CorrelationFile.h"
+#include "LazyCorrelationMatrix.h"
+#include "DataStream.h"
 
 using namespace Rcpp;
 
@@ -44,15 +48,57 @@ using namespace Rcpp;
 //      wrap<>: convert C++ to Rcpp object (type handled automatically)
 //
 
+//
+// Converts the output of gridCCDr into one R object per lambda (see get_R). The path is read in order, so only one
+//   estimate is reconstructed at a time and none of them are copied; the blocks vector is not returned to R. The
+//   number of KKT violations found by gridCCDr for each lambda is added as kkt.violations.
+//
+std::vector<List> pathToR(const SolutionPath& path, const std::vector<int>& violations){
+    std::vector<List> return_betas;
+
+    SolutionPath::Cursor it(path);
+    while(it.next()){
+        List out = it.betas().get_R(it.lambda(), false);
+        out.push_back(wrap(violations[it.index()]), "kkt.violations");
+        return_betas.push_back(out);
+    }
+
+    return return_betas;
+}
+
+//
+// The exports below point PackedSymmetricMatrix at the R vector of correlations, so its length has to be checked
+//   against the dimension of betas before anything is read from it.
+//
+void checkCorrelations(const NumericVector& cors, int pp){
+    if(static_cast<std::size_t>(cors.size()) != static_cast<std::size_t>(pp) * (pp + 1) / 2){
+        stop("Length of the correlation vector does not match the dimension of betas.");
+    }
+}
+
+// The memory layout is passed from R as an integer, and must be one of PackedSymmetricMatrix::Layout
+PackedSymmetricMatrix::Layout checkLayout(int layout){
+    if(layout != PackedSymmetricMatrix::PACKED && layout != PackedSymmetricMatrix::TILED && layout != PackedSymmetricMatrix::PACKED_BY_ROW){
+        stop("Unknown layout for the correlations: must be 0 (packed), 1 (tiled) or 2 (packed by row).");
+    }
+
+    return static_cast<PackedSymmetricMatrix::Layout>(layout);
+}
+
 // [[Rcpp::export]]
 List gridCCDr(NumericVector cors,
               List init_betas,
               unsigned int nn,
               NumericVector lambdas,
               NumericVector params,
-              int verbose
+              int verbose,
+              int layout = 0,
+              bool single = false,
+              bool screen = false
               ){
-    SparseBlockMatrix betas = SparseBlockMatrix(init_betas);
+    SparseBlockMatrix betas(init_betas);
+    checkCorrelations(cors, betas.dim());
+    PackedSymmetricMatrix::Layout lay = checkLayout(layout);
 
     #ifdef _DEBUG_ON_
         //
@@ -65,20 +111,34 @@ List gridCCDr(NumericVector cors,
         FILE_LOG(logINFO) << "Log file opened.";
     #endif
 
-    std::vector<SparseBlockMatrix> grid_betas;
-    grid_betas = gridCCDr(as< std::vector<double> >(cors),
-                          betas,
-                          nn,
-                          as< std::vector<double> >(lambdas),
-                          as< std::vector<double> >(params),
-                          verbose);
-
-    std::vector<List> return_betas;
-    for(int i = 0; i < grid_betas.size(); ++i){
-        return_betas.push_back(grid_betas[i].get_R(lambdas[i]));
+    // The path returned by gridCCDr is swapped into grid_betas rather than copied (see SolutionPath::swap)
+    SolutionPath grid_betas(betas.dim());
+    std::vector<int> violations;
+    if(single){
+        // Single precision copy of the correlations (see PackedSymmetricMatrix.h)
+        PackedSymmetricMatrixFloat cors_psm(REAL(cors), betas.dim(), lay);
+        gridCCDr(cors_psm,
+                 betas,
+                 nn,
+                 as< std::vector<double> >(lambdas),
+                 as< std::vector<double> >(params),
+                 verbose,
+                 screen,
+                 &violations).swap(grid_betas);
+    } else{
+        // Point directly at the R vector unless a different memory layout is requested
+        PackedSymmetricMatrix cors_psm(REAL(cors), betas.dim(), lay);
+        gridCCDr(cors_psm,
+                 betas,
+                 nn,
+                 as< std::vector<double> >(lambdas),
+                 as< std::vector<double> >(params),
+                 verbose,
+                 screen,
+                 &violations).swap(grid_betas);
     }
 
-    return wrap(return_betas);
+    return wrap(pathToR(grid_betas, violations));
 }
 
 // [[Rcpp::export]]
@@ -87,25 +147,232 @@ List singleCCDr(NumericVector cors,
                 unsigned int nn,
                 double lambda,
                 NumericVector params,
-                int verbose
+                int verbose,
+                int layout = 0,
+                bool single = false
                 ){
 
-    SparseBlockMatrix betas = SparseBlockMatrix(init_betas);
+    SparseBlockMatrix betas(init_betas);
+    checkCorrelations(cors, betas.dim());
+    PackedSymmetricMatrix::Layout lay = checkLayout(layout);
+    CCDrCounters counters;
 
-    betas = singleCCDr(as< std::vector<double> >(cors),
-                       betas,
-                       nn,
-                       lambda,
-                       as< std::vector<double> >(params),
-                       verbose);
+    if(single){
+        PackedSymmetricMatrixFloat cors_psm(REAL(cors), betas.dim(), lay);
+        singleCCDrInPlace(cors_psm,
+                          betas,
+                          nn,
+                          lambda,
+                          as< std::vector<double> >(params),
+                          verbose,
+                          NULL,
+                          &counters);
+    } else{
+        PackedSymmetricMatrix cors_psm(REAL(cors), betas.dim(), lay);
+        singleCCDrInPlace(cors_psm,
+                          betas,
+                          nn,
+                          lambda,
+                          as< std::vector<double> >(params),
+                          verbose,
+                          NULL,
+                          &counters);
+    }
     //
     // Need to manually recompute active set size when calling singleCCDr directly from R,
     //   as opposed to within gridCCDr, which automatically recomputes the active set size
     //
     betas.recomputeActiveSetSize(true);
 
+    // Also report the work done by the algorithm (see CCDrCounters)
+    List out = betas.get_R(lambda);
+    out.push_back(wrap(static_cast<double>(counters.sweeps)), "sweeps");
+    out.push_back(wrap(static_cast<double>(counters.iters)), "iters");
+    out.push_back(wrap(static_cast<double>(counters.updates)), "updates");
+    out.push_back(wrap(static_cast<double>(counters.sigmas)), "sigmas.updated");
+    out.push_back(wrap(static_cast<double>(counters.sigmasSkipped)), "sigmas.skipped");
+    out.push_back(wrap(counters.sigmaSeconds), "sigma.time");
+    out.push_back(wrap(counters.seconds), "time");
+
+    return out;
+}
+
+// [[Rcpp::export]]
+NumericVector packedCorrelations(NumericMatrix X,
+                                 int nthreads
+                                 ){
+    std::size_t nn = X.nrow(), pp = X.ncol();
+    NumericVector cors(pp * (pp + 1) / 2);
+
+    // Write directly into the R vector to avoid an extra copy of the output
+    packedCorrelations(REAL(X), nn, pp, REAL(cors), nthreads);
+
+    return cors;
+}
+
+// [[Rcpp::export]]
+NumericVector sparsePackedCorrelations(IntegerVector colPtr,
+                                       IntegerVector rowIdx,
+                                       NumericVector vals,
+                                       int nn,
+                                       int nthreads
+                                       ){
+    std::size_t pp = colPtr.size() - 1;
+    NumericVector cors(pp * (pp + 1) / 2);
+
+    // Works directly on the slots of the dgCMatrix (p, i, x), so the data is never made dense
+    packedCorrelations(INTEGER(colPtr), INTEGER(rowIdx), REAL(vals), nn, pp, REAL(cors), nthreads);
+
+    return cors;
+}
+
+// [[Rcpp::export]]
+List updateSufficientStats(NumericMatrix X,
+                           NumericVector means,
+                           NumericVector comoments,
+                           int nn,
+                           int nthreads
+                           ){
+    std::size_t pp = X.ncol();
+    if(static_cast<std::size_t>(means.size()) != pp || static_cast<std::size_t>(comoments.size()) != pp * (pp + 1) / 2){
+        stop("Dimension of the new data does not match the sufficient statistics.");
+    }
+
+    // Work on copies so that the statistics passed in from R are left untouched
+    NumericVector new_means = clone(means), new_comoments = clone(comoments);
+    updateComoments(REAL(X), X.nrow(), pp, nn, REAL(new_means), REAL(new_comoments), nthreads);
+
+    return List::create(_["nn"] = wrap(nn + X.nrow()), _["means"] = new_means, _["comoments"] = new_comoments);
+}
+
+// [[Rcpp::export]]
+NumericVector sufficientStatsCorrelations(NumericVector comoments,
+                                          int pp
+                                          ){
+    NumericVector cors(comoments.size());
+    comomentCorrelations(REAL(comoments), pp, REAL(cors));
+
+    return cors;
+}
+
+// [[Rcpp::export]]
+List streamSufficientStats(std::string path,
+                           std::string format,
+                           bool header,
+                           std::string sep,
+                           int nrow,
+                           int ncol,
+                           int nthreads
+                           ){
+    std::size_t nn = 0;
+    std::vector<double> means, comoments;
+    bool ok;
+
+    // The file is read once, in chunks of rows, so only one chunk is ever held in memory
+    if(format == "csv"){
+        CsvDataStream in(path, header, sep.empty() ? ',' : sep[0]);
+        ok = streamSufficientStats(in, nn, means, comoments, _STREAM_CHUNK_ROWS_, nthreads);
+    } else{
+        BinaryDataStream in(path, nrow, ncol);
+        ok = streamSufficientStats(in, nn, means, comoments, _STREAM_CHUNK_ROWS_, nthreads);
+    }
+
+    if(!ok) stop("Unable to read data file: " + path);
+
+    return List::create(_["nn"] = wrap(static_cast<int>(nn)), _["means"] = wrap(means), _["comoments"] = wrap(comoments));
+}
+
+// [[Rcpp::export]]
+bool writeCorrelationFile(NumericMatrix X,
+                          std::string path,
+                          bool single,
+                          int nthreads
+                          ){
+    return CorrelationFile::write(path, REAL(X), X.nrow(), X.ncol(), PackedSymmetricMatrix::PACKED_BY_ROW, single, nthreads);
+}
+
+// [[Rcpp::export]]
+List correlationFileInfo(std::string path){
+    CorrelationFile file(path);
+    if(!file.isOpen()) stop("Unable to read correlation file: " + path);
+
+    return List::create(_["pp"] = wrap(static_cast<int>(file.dim())), _["nn"] = wrap(file.samples()), _["layout"] = wrap(static_cast<int>(file.layout())), _["single"] = wrap(file.singlePrecision()));
+}
+
+// [[Rcpp::export]]
+List gridCCDrFile(std::string path,
+                  List init_betas,
+                  NumericVector lambdas,
+                  NumericVector params,
+                  int verbose,
+                  bool screen = false
+                  ){
+    // The mapping stays open (read-only) for the duration of the call; nothing is copied into memory
+    CorrelationFile file(path);
+    if(!file.isOpen()) stop("Unable to read correlation file: " + path);
+
+    SparseBlockMatrix betas(init_betas);
+    if(static_cast<std::size_t>(betas.dim()) != file.dim()) stop("Dimension of betas does not match the correlation file.");
+
+    SolutionPath grid_betas(betas.dim());
+    std::vector<int> violations;
+    if(file.singlePrecision()){
+        gridCCDr(file.matrixFloat(),
+                 betas,
+                 file.samples(),
+                 as< std::vector<double> >(lambdas),
+                 as< std::vector<double> >(params),
+                 verbose,
+                 screen,
+                 &violations).swap(grid_betas);
+    } else{
+        gridCCDr(file.matrix(),
+                 betas,
+                 file.samples(),
+                 as< std::vector<double> >(lambdas),
+                 as< std::vector<double> >(params),
+                 verbose,
+                 screen,
+                 &violations).swap(grid_betas);
+    }
 
-    return betas.get_R(lambda);
+    return wrap(pathToR(grid_betas, violations));
+}
+
+// [[Rcpp::export]]
+List gridCCDrLazy(NumericMatrix X,
+                  List init_betas,
+                  NumericVector lambdas,
+                  NumericVector params,
+                  int cacheTiles,
+                  int verbose,
+                  bool screen = false
+                  ){
+    SparseBlockMatrix betas(init_betas);
+    if(betas.dim() != X.ncol()) stop("Dimension of betas does not match the data.");
+
+    // Correlations are computed from X on demand and cached in tiles (see LazyCorrelationMatrix.h)
+    LazyCorrelationMatrix cors(REAL(X), X.nrow(), X.ncol(), cacheTiles);
+
+    // The tile cache is updated on every read, so the correlations must only be read from one thread
+    std::vector<double> lazy_params = as< std::vector<double> >(params);
+    if(lazy_params.size() >= 6) lazy_params[4] = 1;
+
+    std::vector<int> violations;
+    SolutionPath grid_betas = gridCCDr(cors,
+                                       betas,
+                                       X.nrow(),
+                                       as< std::vector<double> >(lambdas),
+                                       lazy_params,
+                                       verbose,
+                                       screen,
+                                       &violations);
+
+    if(verbose){
+        OUTPUT << "Correlation cache: " << cors.cacheMisses() << " tiles computed, " << cors.cacheHits() << " hits" << std::endl;
+    }
+
+    return wrap(pathToR(grid_betas, violations));
 }
 
 //---------------------------------------------------------------------------------------------------//
@@ -116,7 +383,14 @@ List singleCCDr(NumericVector cors,
 //  Two cases:
 //  1) Include lambda in list (lambda_R >= 0)
 //  2) Ignore lambda (lambda_R < 0)
-List SparseBlockMatrix::get_R(double lambda_R){
+//  The blocks vector is left out (as after clearBlocks) when blocks_R = false
+List SparseBlockMatrix::get_R(double lambda_R, bool blocks_R) const{
+    // R expects one vector per column, whatever the internal layout (see STORAGE in SparseBlockMatrix.h)
+    std::vector< std::vector<int> > rows, blocks;
+    std::vector< std::vector<double> > vals;
+    getColumns(rows, vals, blocks);
+    if(!blocks_R) blocks.clear();
+
     if(lambda_R < 0)
         return List::create(_["rows"] = wrap(rows), _["vals"] = wrap(vals), _["sigmas"] = wrap(sigmas), _["blocks"] = wrap(blocks), _["length"] = wrap(activeSetLength));
     else